@@ -8,13 +8,21 @@ local next = next
 local pairs = pairs
 local type = type
 
-local session = 0
 local port = {}
+--ȴе, session ĵλ±(slot),λ slot ظʹõĴ
+--task_coroutine[slot] ǵȴЭ, task_session[slot]  slot ǰ session
+local SESSION_SLOT = 0x1000000
 local task_coroutine = {}
 local task_session = {}
-local task_source = {}
+local free_slot = {}
+--е command ЭҪظĵַ session, ֻЭʱ¼
+local co_source = {}
+local co_session = {}
 local command = {}
 local message = {}
+--Ϊ command/message, Эֱִ
+local command_direct = {}
+local message_direct = {}
 
 local cell = {}
 
@@ -25,34 +33,109 @@ cell.self = self
 local event_q1 = {}
 local event_q2 = {}
 
---½һ
+--һ session, ÿе slot
+local function new_session()
+	local n = #free_slot
+	local slot
+	if n > 0 then
+		slot = free_slot[n]
+		free_slot[n] = nil
+	else
+		slot = #task_session + 1
+	end
+	local last = task_session[slot]
+	local session = last and last + SESSION_SLOT or slot
+	task_session[slot] = session
+	return session
+end
+
+--ʧ(ԷѾر)ʱ session
+local function send_session(session, addr, ...)
+	local ok, err = pcall(c.send, addr, ...)
+	if not ok then
+		free_slot[#free_slot+1] = session % SESSION_SLOT
+		error(err, 0)
+	end
+end
+
+--Э̵ȴ event, source  session ЭҪظ command
 local function new_task(source, session, co, event)
-	task_coroutine[event] = co
-	task_session[event] = session
-	task_source[event] = source
+	task_coroutine[event % SESSION_SLOT] = co
+	if source then
+		co_source[co] = source
+		co_session[co] = session
+	end
+end
+
+--ִЭͣ yield Żس,´ resume ʱµĺͲ,ౣ COROUTINE_POOL 
+local COROUTINE_POOL = 64
+local coroutine_pool = {}
+
+--Э̵: f ķֵ(op, ...)  suspend, Ȼȴһ f
+local function co_body(f, ...)
+	return co_body(coroutine.yield(f(...)))
+end
+
+--ӳȡЭִ f(...) ,  co Լ resume Ľ,ֱӴ suspend
+local function co_run(f, ...)
+	local n = #coroutine_pool
+	local co
+	if n > 0 then
+		co = coroutine_pool[n]
+		coroutine_pool[n] = nil
+	else
+		co = coroutine.create(co_body)
+	end
+	return co, coroutine.resume(co, f, ...)
+end
+
+--Эִеĺ⼸,ÿϢհ
+local function co_return(f, ...)
+	return "RETURN", f(...)
+end
+
+local function co_exit(f, ...)
+	f(...)
+	return "EXIT"
+end
+
+--ȵ event Ѻִ f,  fork  timeout
+local function co_wait(f, event)
+	coroutine.yield("WAIT", event)
+	f()
+	return "EXIT"
+end
+
+--ֱִ(Э)ĺ
+local function check_yieldable()
+	local _, main = coroutine.running()
+	if main then
+		error("attempt to block in a direct handler", 3)
+	end
 end
 
+local suspend
+
 --Э
 function cell.fork(f)
-	local co = coroutine.create(function() f() return "EXIT" end)
-	session = session + 1
-	new_task(nil, nil, co, session)
+	local session = new_session()
+	suspend(nil, nil, co_run(co_wait, f, session))
 	
 	cell.wakeup(session)
 end
 
 --ʱЭ
 function cell.timeout(ti, f)
-	local co = coroutine.create(function() f() return "EXIT" end)
-	session = session + 1
+	local session = new_session()
 	
 	c.send(system, 2, self, session, "timeout", ti)
-	new_task(nil, nil, co, session)
+	suspend(nil, nil, co_run(co_wait, f, session))
 end
 
 --˯
 function cell.sleep(ti)
-	session = session + 1
+	check_yieldable()
+	local session = new_session()
 	c.send(system, 2, self, session, "timeout", ti)
 	coroutine.yield("WAIT", session)
 end
@@ -63,29 +146,223 @@ function cell.wakeup(event)
 end
 
 function cell.event()
-	session = session + 1
-	return session
+	return new_session()
 end
 
 --ȴ
 function cell.wait(event)
+	check_yieldable()
 	coroutine.yield("WAIT", event)
 end
 
+--Э cell.call  cell.rawcall ĳʱʱ, Э̷Żسʱ
+local call_timeout = {}
+
+--õǰЭ cell.call  cell.rawcall ĳʱʱ(λ 0.01 ), nil ʾʱ
+--ʱĵ׳ "timeout", ٵĻظ. ֮ǰ
+function cell.calltimeout(ti)
+	local co = coroutine.running()
+	local last = call_timeout[co]
+	call_timeout[co] = ti
+	return last
+end
+
+--͵, صȴ future
+--future ռ session  slot ,ظʱͷ slot
+local function send_future(session, addr, ...)
+	local f = { session = session }
+	send_session(session, addr, ...)
+	task_coroutine[session % SESSION_SLOT] = f
+	return f
+end
+
 --Ϣ
 function cell.call(addr, ...)
 	-- command
-	session = session + 1
-	c.send(addr, 2, cell.self, session, ...)
+	check_yieldable()
+	local session = new_session()
+	local ti = call_timeout[coroutine.running()]
+	if ti then
+		return cell.await(send_future(session, addr, 2, cell.self, session, ...), ti)
+	end
+	send_session(session, addr, 2, cell.self, session, ...)
 	return select(2,assert(coroutine.yield("WAIT", session)))
 end
 
 --Ϣ
 function cell.rawcall(addr, session, ...)
-	c.send(addr, ...)
+	check_yieldable()
+	local ti = call_timeout[coroutine.running()]
+	if ti then
+		return cell.await(send_future(session, addr, ...), ti)
+	end
+	send_session(session, addr, ...)
 	return select(2,assert(coroutine.yield("WAIT", session)))
 end
 
+--첽, future,  cell.await ȴ
+function cell.async(addr, ...)
+	local session = new_session()
+	return send_future(session, addr, 2, cell.self, session, ...)
+end
+
+--ظ, ,еȴЭ
+--ͬһЭ̿ڵȴ future, w.event ÿձظ
+local function future_done(f, ...)
+	f.result = table.pack(...)
+	local waiters = f.waiters
+	if waiters then
+		f.waiters = nil
+		for w in pairs(waiters) do
+			if w.event then
+				cell.wakeup(w.event)
+				w.event = nil
+			end
+		end
+	end
+end
+
+--ȴһ future ,
+local function future_wait(futures)
+	for i = 1, #futures do
+		if futures[i].result then
+			return i
+		end
+	end
+	check_yieldable()
+	--Э̿Եȴͬһ future, ÿ future ¼еȴ
+	local w = { event = cell.event() }
+	for i = 1, #futures do
+		local f = futures[i]
+		local waiters = f.waiters
+		if waiters == nil then
+			waiters = {}
+			f.waiters = waiters
+		end
+		waiters[w] = true
+	end
+	cell.wait(w.event)
+	--ֻƳԼ
+	for i = 1, #futures do
+		local waiters = futures[i].waiters
+		if waiters then
+			waiters[w] = nil
+		end
+	end
+	for i = 1, #futures do
+		if futures[i].result then
+			return i
+		end
+	end
+	error "No future finished"
+end
+
+local function future_result(f)
+	local r = f.result
+	return select(2, assert(table.unpack(r, 1, r.n)))
+end
+
+--ȡ future, ȴЭ̵õ err (Ĭ "cancelled"), ֮󵽴Ļظֱ C ж
+function cell.cancel(f, err)
+	if f.result == nil then
+		local slot = f.session % SESSION_SLOT
+		if task_coroutine[slot] == f then
+			task_coroutine[slot] = nil
+			free_slot[#free_slot+1] = slot
+		end
+		c.cancel(f.session)
+		future_done(f, false, err or "cancelled")
+	end
+end
+
+--future Ķʱֻռһ slot, ҪЭ. ȴ timer_stop ſ futures
+--ʱʱ futures ѾſʲôҲ, slot ֮
+local timer_meta = {}
+
+local function timer_expire(timer)
+	local futures = timer.futures
+	if futures then
+		timer.futures = nil
+		for i = 1, #futures do
+			cell.cancel(futures[i], "timeout")
+		end
+	end
+end
+
+--ti (λ 0.01 ) ֮ȡлûɵ future
+local function future_timeout(futures, ti)
+	if ti then
+		local session = new_session()
+		c.send(system, 2, self, session, "timeout", ti)
+		local timer = setmetatable({ futures = futures }, timer_meta)
+		task_coroutine[session % SESSION_SLOT] = timer
+		return timer
+	end
+end
+
+local function timer_stop(timer)
+	if timer then
+		timer.futures = nil
+	end
+end
+
+--ȴ future Ľ, cell.call һ,Էʱ׳. ti Ϊʱʱ
+function cell.await(f, ti)
+	if f.result == nil then
+		local futures = { f }
+		local timer = future_timeout(futures, ti)
+		future_wait(futures)
+		timer_stop(timer)
+	end
+	return future_result(f)
+end
+
+--ʱ cell.call, ʱ׳ "timeout"
+function cell.timedcall(ti, addr, ...)
+	return cell.await(cell.async(addr, ...), ti)
+end
+
+--ȴ future, ,ÿһ table.pack Ľ. ȫɺ׳һ
+function cell.awaitall(futures, ti)
+	local timer = future_timeout(futures, ti)
+	local r = {}
+	local err
+	for i = 1, #futures do
+		local f = futures[i]
+		if f.result == nil then
+			future_wait { f }
+		end
+		local result = f.result
+		if result[1] then
+			r[i] = table.pack(select(2, table.unpack(result, 1, result.n)))
+		else
+			err = err or result[2]
+		end
+	end
+	timer_stop(timer)
+	if err then
+		error(err, 0)
+	end
+	return r
+end
+
+--ȴһ future, еԼ
+function cell.awaitany(futures, ti)
+	local timer = future_timeout(futures, ti)
+	local i = future_wait(futures)
+	timer_stop(timer)
+	return i, future_result(futures[i])
+end
+
+-- cell ͬʱͬ,ȴлظ. ʱȡǸ
+function cell.callmulti(addrs, ...)
+	local futures = {}
+	for i = 1, #addrs do
+		futures[i] = cell.async(addrs[i], ...)
+	end
+	return cell.awaitall(futures)
+end
+
 --Ϣ
 function cell.send(addr, ...)
 	-- message
@@ -105,6 +382,42 @@ function cell.dispatch(p)
 	port[id] = p
 end
 
+-- cell  gc  { pause = , stepmul = , mode = "generational" | "incremental", step = }
+--߳̿ʱϢ cell  gc, step ÿһĴС(μ lua_gc LUA_GCSTEP)
+--Ե pause  gc ڴϢʱ,ķڿʱ
+function cell.gc(opts)
+	if opts.pause then
+		collectgarbage("setpause", opts.pause)
+	end
+	if opts.stepmul then
+		collectgarbage("setstepmul", opts.stepmul)
+	end
+	if opts.mode then
+		collectgarbage(opts.mode)
+	end
+	if opts.step then
+		c.gcstep(opts.step)
+	end
+end
+
+-- cell  cell.main(...) ,  cell  main ķֵ
+--ڵǰĹ߳д, system cell, Զ cell ͬʱ launch
+--name  { "test.client", libs = { "string" } } , ֻ libs еı׼,ڵһηʱ
+function cell.launch(name, ...)
+	local libs
+	if type(name) == "table" then
+		libs = name.libs
+		name = name[1]
+	end
+	local addr = c.launch(name, libs)
+	if addr == nil then
+		error ("launch " ..  name .. " failed")
+	end
+	-- 4 is launch port
+	local ev = cell.event()
+	return addr, cell.rawcall(addr, ev, 4, self, ev, true, ...)
+end
+
 --syste
 function cell.cmd(...)
 	return cell.call(system, ...)
@@ -118,20 +431,52 @@ function cell.exit()
 end
 
 
-function cell.command(cmdfuncs)
+--direct Ϊ true  { name = true } , Щ,Эֱִ
+--ֱִеĺе call wait sleep Ľӿڻ׳
+local function set_direct(funcs, direct)
+	local t = {}
+	if direct == true then
+		for k in pairs(funcs) do
+			t[k] = true
+		end
+	elseif direct then
+		for k in pairs(direct) do
+			t[k] = true
+		end
+	end
+	return t
+end
+
+function cell.command(cmdfuncs, direct)
 	command = cmdfuncs
+	command_direct = set_direct(cmdfuncs, direct)
 end
 
-function cell.message(msgfuncs)
+function cell.message(msgfuncs, direct)
 	message = msgfuncs
+	message_direct = set_direct(msgfuncs, direct)
+end
+
+--ЭִŻس
+local function co_park(co)
+	call_timeout[co] = nil
+	local n = #coroutine_pool
+	if n < COROUTINE_POOL then
+		coroutine_pool[n+1] = co
+	end
 end
 
-local function suspend(source, session, co, ok, op, ...)
+function suspend(source, session, co, ok, op, ...)
+	if source and op ~= "WAIT" then
+		co_source[co] = nil
+		co_session[co] = nil
+	end
 	if ok then
 		if op == "RETURN" then
+			co_park(co)
 			c.send(source, 1, session, true, ...)
 		elseif op == "EXIT" then
-			-- do nothing
+			co_park(co)
 		elseif op == "WAIT" then
 			new_task(source, session, co, ...)
 		else
@@ -146,16 +491,20 @@ local function suspend(source, session, co, ok, op, ...)
 end
 
 local function resume_co(session, ...)
-	local co = task_coroutine[session]
-	if co == nil then
+	local slot = session % SESSION_SLOT
+	local co = task_coroutine[slot]
+	if co == nil or task_session[slot] ~= session then
 		error ("Unknown response : " .. tostring(session))
 	end
-	local reply_session = task_session[session]
-	local reply_addr = task_source[session]
-	task_coroutine[session] = nil
-	task_session[session] = nil
-	task_source[session] = nil
-	suspend(reply_addr, reply_session, co, coroutine.resume(co, ...))
+	task_coroutine[slot] = nil
+	free_slot[#free_slot+1] = slot
+	if type(co) == "table" then
+		if getmetatable(co) == timer_meta then
+			return timer_expire(co)
+		end
+		return future_done(co, ...)
+	end
+	suspend(co_source[co], co_session[co], co, coroutine.resume(co, ...))
 end
 
 local function deliver_event()
@@ -178,11 +527,16 @@ local sockets = {}
 local sockets_event = {}
 local sockets_arg = {}
 local sockets_closed = {}
+local sockets_limit = {}
 local sockets_fd = nil
+local sockets_pool = nil
 local sockets_accept = {}
+local sockets_udp = {}
+local sockets_drain = {}
 
 local socket = {}
 local listen_socket = {}
+local udp_socket = {}
 
 local function close_msg(self)
 	cell.send(sockets_fd, "disconnect", self.__fd)
@@ -204,6 +558,35 @@ local listen_meta = {
 	end,
 }
 
+local udp_meta = {
+	__index = udp_socket,
+	__gc = close_msg,
+	__tostring = function(self)
+		return "[socket udp: " .. self.__fd .. "]"
+	end,
+}
+
+--ȡsocket cell,Լֱдݵsocket_pool
+local function init_socket()
+	if sockets_fd == nil then
+		sockets_fd, sockets_pool = cell.cmd("socket")
+	end
+end
+
+local function socket_wait(fd, sep)
+	check_yieldable()
+	assert(sockets_event[fd] == nil)
+	sockets_event[fd] = cell.event()
+	sockets_arg[fd] = sep
+	cell.wait(sockets_event[fd])
+end
+
+--׽ѡ,Ƿɹ
+function socket:setopt(name, value)
+	return csocket.setopt(sockets_pool, self.__fd, name, value)
+end
+
+listen_socket.setopt = socket.setopt
 
 --todo:
 function listen_socket:disconnect()
@@ -212,55 +595,173 @@ function listen_socket:disconnect()
 end
 
 --connect 
-function cell.connect(addr, port)
-	sockets_fd = sockets_fd or cell.cmd("socket")
-	local obj = { __fd = assert(cell.call(sockets_fd, "connect", self, addr, port), "Connect failed") }
+--opts Ϊ׽ѡ {nodelay, cork, keepalive, rcvbuf, sndbuf, fastopen}
+function cell.connect(addr, port, opts)
+	init_socket()
+	local obj = { __fd = assert(cell.call(sockets_fd, "connect", self, addr, port, opts), "Connect failed") }
 	return setmetatable(obj, socket_meta)
 end
 
-function cell.listen(port, accepter)
+--addr Ϊ "port" "ip:port" "[ipv6]:port" "unix:/path"  "unix:@name"
+--accepter(fd, addr, listen_obj, port) , unix ׽ֵ port Ϊ 0
+--opts  connect ѡ⻹֧ backlog, defer_accept, nodelay Ӧõյ
+function cell.listen(addr, accepter, opts)
 	assert(type(accepter) == "function")
-	sockets_fd = sockets_fd or cell.cmd("socket")
-	local obj = { __fd = assert(cell.call(sockets_fd, "listen", self, port), "Listen failed") }
-	sockets_accept[obj.__fd] =  function(fd, addr)
-		return accepter(fd, addr, obj)
+	init_socket()
+	local obj = { __fd = assert(cell.call(sockets_fd, "listen", self, addr, opts), "Listen failed") }
+	sockets_accept[obj.__fd] =  function(fd, addr, port)
+		return accepter(fd, addr, obj, port)
 	end
 	return setmetatable(obj, listen_meta)
 end
 
+--,һˮλʱͣм׽(pause)߽պر(shed)
+--ȫˮλ»ָ. pending: еϢ, runnable: Ϣcell, memory: ڴֽ
+--cell.admission { mode = "pause", pending = 100000, runnable = {64, 16}, memory = 1024*1024*1024 }
+function cell.admission(opts)
+	init_socket()
+	cell.call(sockets_fd, "admission", opts)
+end
+
+--ظԼܾͳ
+function cell.load()
+	init_socket()
+	return cell.call(sockets_fd, "load")
+end
+
 function cell.bind(fd)
-	sockets_fd = sockets_fd or cell.cmd("socket")
+	init_socket()
 	local obj = { __fd = fd }
 	return setmetatable(obj, socket_meta)
 end
 
+--udp׽,addr Ϊ "ip:port"
+-- callback ʱյݱЭе callback(data, from), udp_socket:recv() ȡ
+--limit Ϊն(е callback)ݱ,Ĭ UDP_QUEUE, Ժյݱ
+local UDP_QUEUE = 1024
+
+function cell.udp(addr, callback, limit)
+	init_socket()
+	local obj = { __fd = assert(cell.call(sockets_fd, "udp", self, addr), "Udp failed") }
+	sockets_udp[obj.__fd] = {
+		head = 1,
+		tail = 0,
+		callback = callback,
+		running = 0,
+		limit = limit or UDP_QUEUE,
+		dropped = 0,
+	}
+	return setmetatable(obj, udp_meta)
+end
+
+--ݱ
+function udp_socket:dropped()
+	local q = sockets_udp[self.__fd]
+	return q and q.dropped or 0
+end
+
+-- host, port ת sendto ʹõĵַ
+cell.udpaddress = csocket.udpaddress
+cell.udpname = csocket.udpname
+
+--ݱ  udp:sendto(addr1, data1, addr2, data2, ...)
+function udp_socket:sendto(...)
+	return csocket.sendto(sockets_pool, self.__fd, ...)
+end
+
+--ȡһݱ, data, from
+function udp_socket:recv()
+	local fd = self.__fd
+	local q = sockets_udp[fd]
+	if q == nil or q.callback then
+		return
+	end
+	if q.head > q.tail then
+		if sockets_closed[fd] then
+			return
+		end
+		socket_wait(fd)
+	end
+	local i = q.head
+	if i > q.tail then
+		return
+	end
+	local data, from = q[i], q[i+1]
+	q[i], q[i+1] = nil, nil
+	q.head = i + 2
+	return data, from
+end
+
+function udp_socket:disconnect()
+	sockets_udp[self.__fd] = nil
+	socket.disconnect(self)
+end
+
 --Ͽ
+--еȴдЭ
+local function wakeup_drain(fd)
+	local q = sockets_drain[fd]
+	if q then
+		for i=1,#q do
+			cell.wakeup(q[i])
+		end
+		sockets_drain[fd] = nil
+	end
+end
+
 function socket:disconnect()
 	assert(sockets_fd)
 	local fd = self.__fd
 	sockets[fd] = nil
 	sockets_closed[fd] = true
+	sockets_limit[fd] = nil
 	if sockets_event[fd] then
 		cell.wakeup(sockets_event[fd])
 	end
+	wakeup_drain(fd)
 
 	cell.send(sockets_fd, "disconnect", fd)
 end
 
 --дϢ
+--дˮλʱ,ֱˮλ»ӶϿ
 function socket:write(msg)
+	--ֱڱcellд,پsocket cellת
 	local fd = self.__fd
-	cell.rawsend(sockets_fd, 6, fd, csocket.sendpack(msg))
+	local ok, full = csocket.write(sockets_pool, fd, msg)
+	if full then
+		--жЭͬʱڵȴ
+		local ev = cell.event()
+		local q = sockets_drain[fd]
+		if q == nil then
+			q = {}
+			sockets_drain[fd] = q
+		end
+		table.insert(q, ev)
+		cell.wait(ev)
+	end
+	return ok
+end
+
+--ļܵ,ں sendfile/splice ,֮ǰд֮
+--len ʡʱ͵ļβ(ܵΪر),ļʧܷ nil, err
+function socket:sendfile(file, offset, len)
+	return csocket.sendfile(sockets_pool, self.__fd, file, offset, len)
 end
 
+--óʱ,λ cell.timeout ͬ(0.01),Ϊ 0  nil ʾ
+--idle: շû, read: ûյ, write: ݵȴ͵Ƿȥ
+--ʱӱر,ȴдЭ̱(ȡ nil)
+function socket:timeout(idle, read, write)
+	return csocket.timeout(sockets_pool, self.__fd, idle, read, write)
+end
 
-local function socket_wait(fd, sep)
-	assert(sockets_event[fd] == nil)
-	sockets_event[fd] = cell.event()
-	sockets_arg[fd] = sep
-	cell.wait(sockets_event[fd])
+--дĸˮλ͵ˮλ(ֽ),high Ϊ 0 ʾ,low ĬΪ high  1/4
+function socket:watermark(high, low)
+	csocket.watermark(sockets_pool, self.__fd, high, low)
 end
 
+
 --ȡϢ
 function socket:readbytes(bytes)
 	local fd = self.__fd
@@ -283,7 +784,8 @@ function socket:readbytes(bytes)
 end
 
 --ȡһϢ
-function socket:readline(sep)
+--limit Ϊг,ʱ nil, "Line too long"
+function socket:readline(sep, limit)
 	local fd = self.__fd
 	if sockets_closed[fd] then
 		sockets[fd] = nil
@@ -291,39 +793,134 @@ function socket:readline(sep)
 	end
 	sep = sep or "\n"
 	if sockets[fd] then
-		local line = csocket.readline(sockets[fd], sep)
+		local line = csocket.readline(sockets[fd], sep, nil, limit)
 		if line then
 			return line
+		elseif line == false then
+			return nil, "Line too long"
 		end
 	end
+	sockets_limit[fd] = limit
 	socket_wait(fd, sep)
 	if sockets_closed[fd] then
 		sockets[fd] = nil
 		return
 	end
-	return csocket.readline(sockets[fd], sep)
+	local line = csocket.readline(sockets[fd], sep, nil, limit)
+	if line == false then
+		return nil, "Line too long"
+	end
+	return line
+end
+
+local function packet_result(r, ...)
+	if r == false then
+		return nil, "Packet too large"
+	end
+	return r, ...
+end
+
+--ȡ 2  4 ֽڳΪͷݰ,endian Ϊ "big"(Ĭ)  "little"
+--n  1 ʱ෵ n Ѿȫİ
+--limit Ϊ(Ĭ 16M),ʱ nil, "Packet too large", ֮޷ٰȡ,ӦöϿ
+function socket:readpacket(header, endian, n, limit)
+	local fd = self.__fd
+	if sockets_closed[fd] then
+		sockets[fd] = nil
+		return
+	end
+	header = header or 2
+	endian = endian or "big"
+	local buffer = sockets[fd]
+	local ok = buffer and csocket.readpacket(buffer, header, endian, true, 1, limit)
+	if ok == nil then
+		socket_wait(fd, { header, endian, limit })
+		if sockets_closed[fd] then
+			sockets[fd] = nil
+			return
+		end
+		buffer = sockets[fd]
+	end
+	return packet_result(csocket.readpacket(buffer, header, endian, false, n, limit))
 end
 
 ----------------------------------------
 
+--udp Ļص, running ǻûз()Ļص
+local function co_udp(q, data, from)
+	q.running = q.running + 1
+	local ok, err = pcall(q.callback, data, from)
+	q.running = q.running - 1
+	if not ok then
+		print(cell.self, err)
+	end
+	return "EXIT"
+end
+
+local function co_accept(accepter, fd, addr, port)
+	local forward = accepter(fd, addr, port) or self
+	cell.call(sockets_fd, "forward", fd, forward)
+	return "EXIT"
+end
+
 cell.dispatch {
 	id = 6, -- socket
-	dispatch = function(fd, sz, msg)
+	dispatch = function(fd, sz, msg, port)
+		local udp = sockets_udp[fd]
+		if udp then
+			-- udp: һյĶݱ msg , data1, from1, data2, from2 ...
+			local ev = sockets_event[fd]
+			if sz == 0 then
+				sockets_closed[fd] = true
+			else
+				local r = { csocket.udpunpack(msg, sz) }
+				if udp.callback then
+					for i = 1, #r, 2 do
+						if udp.running >= udp.limit then
+							udp.dropped = udp.dropped + 1
+						else
+							suspend(nil, nil, co_run(co_udp, udp, r[i], r[i+1]))
+						end
+					end
+					return
+				end
+				local tail = udp.tail
+				for i = 1, #r, 2 do
+					if (tail - udp.head + 1) / 2 >= udp.limit then
+						udp.dropped = udp.dropped + 1
+					else
+						udp[tail + 1] = r[i]
+						udp[tail + 2] = r[i+1]
+						tail = tail + 2
+					end
+				end
+				udp.tail = tail
+			end
+			if ev then
+				cell.wakeup(ev)
+				sockets_event[fd] = nil
+			end
+			return
+		end
 		local accepter = sockets_accept[fd]
 		if accepter then
-			-- accepter: new fd (sz) ,  ip addr (msg)
-			local co = coroutine.create(function()
-				local forward = accepter(sz,msg) or self
-				cell.call(sockets_fd, "forward", sz , forward)
-				return "EXIT"
-			end)
-			suspend(nil, nil, co, coroutine.resume(co))
+			-- accepter: new fd (sz) ,  ip addr (msg) , port
+			suspend(nil, nil, co_run(co_accept, accepter, sz, msg, port))
+			return
+		end
+		if sz <= 0 then
+			-- sz == -1 : д˵ˮλ
+			wakeup_drain(fd)
+		end
+		if sz == -1 then
 			return
 		end
 		local ev = sockets_event[fd]
 		--sockets_event[fd] = nil
-		if sz == 0 then
+		-- sz == -2 : ʱر
+		if sz <= 0 then
 			sockets_closed[fd] = true
+			sockets_limit[fd] = nil
 			if ev then
 				cell.wakeup(ev)
 				sockets_event[fd] = nil
@@ -334,8 +931,14 @@ cell.dispatch {
 			if ev then
 				local arg = sockets_arg[fd]
 				if type(arg) == "string" then
-					local line = csocket.readline(buffer, arg, true)
-					if line then
+					local line = csocket.readline(buffer, arg, true, sockets_limit[fd])
+					if line ~= nil then
+						cell.wakeup(ev)
+						sockets_event[fd] = nil
+					end
+				elseif type(arg) == "table" then
+					-- readpacket: { header, endian, limit } , ̫ʱҲ
+					if csocket.readpacket(buffer, arg[1], arg[2], true, 1, arg[3]) ~= nil then
 						cell.wakeup(ev)
 						sockets_event[fd] = nil
 					end
@@ -354,8 +957,8 @@ cell.dispatch {
 	id = 5, -- exit
 	dispatch = function()
 		local err = tostring(self) .. " is dead"
-		for event,session in pairs(task_session) do
-			local source = task_source[event]
+		for co,session in pairs(co_session) do
+			local source = co_source[co]
 			if source ~= self then
 				c.send(source, 1, session, false, err)
 			end
@@ -366,34 +969,47 @@ cell.dispatch {
 cell.dispatch {
 	id = 4, -- launch
 	dispatch = function(source, session, report, ...)
-		local op = report and "RETURN" or "EXIT"
-		local co = coroutine.create(function(...) return op, cell.main(...) end)
-		suspend(source, session, co, coroutine.resume(co,...))
+		suspend(source, session, co_run(report and co_return or co_exit, cell.main, ...))
 	end
 }
 
+
 cell.dispatch {
 	id = 3, -- message
 	dispatch = function(cmd, ...)
 		local f = message[cmd]
 		if f == nil then
 			print("Unknown message ", cmd)
+		elseif message_direct[cmd] then
+			local ok, err = pcall(f, ...)
+			if not ok then
+				print(cell.self, err)
+			end
 		else
-			local co = coroutine.create(function(...) return "EXIT", f(...) end)
-			suspend(source, session, co, coroutine.resume(co,...))
+			suspend(nil, nil, co_run(co_exit, f, ...))
 		end
 	end
 }
 
+--ֱִеĽظ
+local function direct_command(source, session, ok, ...)
+	if ok then
+		c.send(source, 1, session, true, ...)
+	else
+		c.send(source, 1, session, false, (...))
+	end
+end
+
 cell.dispatch {
 	id = 2,	-- command
 	dispatch = function(source, session, cmd, ...)
 		local f = command[cmd]
 		if f == nil then
 			c.send(source, 1, session, false, "Unknown command " ..  cmd)
+		elseif command_direct[cmd] then
+			direct_command(source, session, pcall(f, ...))
 		else
-			local co = coroutine.create(function(...) return "RETURN", f(...) end)
-			suspend(source, session, co, coroutine.resume(co, ...))
+			suspend(source, session, co_run(co_return, f, ...))
 		end
 	end
 }
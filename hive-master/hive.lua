@@ -9,10 +9,10 @@ local hive = {}
 function hive.start(t)
 	----package.pathвt.main,test.luaУ t.main"test.main" 
 	--ܻ /test/main.lua
-	local main = assert(package.searchpath(t.main, package.path), "main cell was not found")
+	assert(package.searchpath(t.main, package.path), "main cell was not found")
 
-	--({thread = 4,main = "test.main",},system.lua,main.lua)
-	return c.start(t, system_cell, main)
+	--({thread = 4,main = "test.main",},system.lua,"test.main"), main cell  system cell ģ
+	return c.start(t, system_cell, t.main)
 end
 
 return hive
\ No newline at end of file
@@ -9,19 +9,49 @@ local message = {}
 local sockets = {}
 
 --cеõ connect
-function command.connect(source,addr,port)
+--addr , ipv4, "[ipv6]",  "unix:/path" "unix:@name" (Ҫ port)
+--opts Ϊ׽ѡ {nodelay=true, rcvbuf=65536, ...}
+function command.connect(source,addr,port,opts)
 
-	local fd = csocket.connect(addr, port)
+	local fd = csocket.connect(addr, port, opts)
 	if fd then
 		sockets[fd] = source
 		return fd
 	end
 end
 
+--socket_poolָ,cell csocket.write ֱд
+function command.pool()
+	return csocket.pool()
+end
+
+--,عʱͣ߾ܾ
+--opts Ϊ { mode = "pause" | "shed", pending = high | {high, low}, runnable = ..., memory = ... } , nil ʾر
+function command.admission(opts)
+	csocket.admission(opts)
+end
+
+--غͽƵͳ { overload, overloads, accepted, shed, pending, runnable, memory, sockets }
+function command.load()
+	return csocket.load()
+end
+
 --cеõ    socket  bind  listen
-function command.listen(source, port)
+--addr Ϊ "port" "ip:port" "[ipv6]:port" "unix:/path"  "unix:@name"
+--opts Ϊ׽ѡ,֧ backlog
+function command.listen(source, addr, opts)
+
+	local fd = csocket.listen(addr, opts)
+	if fd then
+		sockets[fd] = source
+		return fd
+	end
+end
+
+--udp׽,յݱת source
+function command.udp(source, addr)
 
-	local fd = csocket.listen(port)
+	local fd = csocket.udp(addr)
 	if fd then
 		sockets[fd] = source
 		return fd
@@ -72,8 +102,8 @@ function cell.main()
 			if c then
 				-- ׽
 				if type(v[3]) == "string" then
-					-- accept: listen fd, new fd , ip Ӧ  v[1], v[2], v[3]
-					if not pcall(cell.rawsend,c, 6, v[1], v[2], v[3]) then
+					-- accept: listen fd, new fd , ip , port Ӧ  v[1], v[2], v[3], v[4]
+					if not pcall(cell.rawsend,c, 6, v[1], v[2], v[3], v[4]) then
 						--v[1]ǶӦļ
 						message.disconnect(v[1])
 					else
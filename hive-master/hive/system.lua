@@ -8,6 +8,7 @@ local ticker = 0
 local timer = {}
 local free_queue = {}
 local socket_cell = nil
+local socket_pool = nil
 
 local function alloc_queue()
 	local n = #free_queue
@@ -20,15 +21,21 @@ local function alloc_queue()
 	end
 end
 
+--socket cellԼsocket_pool,cellsocket_poolֱд
 function command.socket()
-	return socket_cell
+	socket_pool = socket_pool or cell.call(socket_cell, "pool")
+	return socket_cell, socket_pool
 end
 
 
---õcеlaunch,һcell
+--õcеlaunch,һcell, ģӦļ c вҲ
 function command.launch(name, ...)
-	local fullname = assert(package.searchpath(name, package.path), "cell was not found")
-	local c = system.launch(fullname)
+	local libs
+	if type(name) == "table" then
+		libs = name.libs
+		name = name[1]
+	end
+	local c = system.launch(name, libs)
 	if c then
 		-- 4 is launch port
 		local ev = cell.event()
@@ -38,6 +45,21 @@ function command.launch(name, ...)
 	end
 end
 
+--ڴͳ { total, pool, cells = { [cell] = bytes } }
+function command.memory()
+	return system.memory()
+end
+
+-- cell ڴ,λֽ, 0 ʾ
+function command.memlimit(c, limit)
+	return system.memlimit(c, limit)
+end
+
+--޸ cell Ĵ, ´ launch ʱ²Һͱ
+function command.clearcache()
+	system.clearcache()
+end
+
 function command.echo(str)
 	return str
 end
@@ -85,8 +107,9 @@ cell.dispatch {
 
 local function start()
 	system.init()
-	local socket = assert(package.searchpath("hive.socket", package.path), "socket cell was not found")
-	socket_cell = assert(system.launch(socket))
+	socket_cell = assert(system.launch("hive.socket"))
+	--socket cell  memory_limit 
+	system.memlimit(socket_cell, 0)
 	print("[system cell]",cell.self)
 	print("[socket cell]",socket_cell)
 	--
@@ -0,0 +1,274 @@
+#include "lua.h"
+#include "lauxlib.h"
+#include "hive_alloc.h"
+#include "hive_cell.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+//ÿ lua_State Լڴ, Сڴ水СּڸԵĿ,ڴֱ realloc
+//һ lua_State ͬһʱֻһ߳ʹ,ԷҪ
+
+#define ALLOC_ALIGN 16
+#define MAX_SMALL 512
+#define SIZE_CLASS (MAX_SMALL / ALLOC_ALIGN)
+#define CHUNK_SIZE 0x4000
+
+#define SIZE_INDEX(sz) (((sz) - 1) / ALLOC_ALIGN)
+
+//Сڴͷźڿ
+struct free_node {
+	struct free_node * next;
+};
+
+// malloc Ĵڴ,зֳСʹ, lua_State رʱһͷ
+struct chunk {
+	struct chunk * next;
+	//֤ݲֶ
+	char pad[ALLOC_ALIGN - sizeof(struct chunk *)];
+};
+
+struct hive_alloc {
+	struct free_node * free[SIZE_CLASS];
+	struct chunk * chunk;
+	char * ptr;			//ǰ chunk δʹõĲ
+	char * end;
+	size_t used;		//lua ʹõֽ
+	size_t pool;		//chunk ռõֽ
+	size_t limit;		//Ϊ 0 ʾ
+	void * owner;		//Ӧ cell
+	struct hive_alloc * prev;
+	struct hive_alloc * next;
+};
+
+//еķһ,ͳ
+static struct hive_alloc * __alloc_list = NULL;
+static int __alloc_lock = 0;
+//½ lua_State Ĭڴ
+static size_t __default_limit = 0;
+
+static inline void
+alloc_lock(void) {
+	while (__sync_lock_test_and_set(&__alloc_lock,1)) {}
+}
+
+static inline void
+alloc_unlock(void) {
+	__sync_lock_release(&__alloc_lock);
+}
+
+static void *
+pool_alloc(struct hive_alloc *a, size_t sz) {
+	int idx = SIZE_INDEX(sz);
+	struct free_node * node = a->free[idx];
+	if (node) {
+		a->free[idx] = node->next;
+		return node;
+	}
+	size_t csz = (idx + 1) * ALLOC_ALIGN;
+	if (a->ptr + csz > a->end) {
+		//ǰ chunk ʣĲַŽӦĿ
+		while (a->ptr + ALLOC_ALIGN <= a->end) {
+			int left = SIZE_INDEX(a->end - a->ptr);
+			node = (struct free_node *)a->ptr;
+			node->next = a->free[left];
+			a->free[left] = node;
+			a->ptr += (left + 1) * ALLOC_ALIGN;
+		}
+		struct chunk * c = malloc(CHUNK_SIZE);
+		if (c == NULL) {
+			return NULL;
+		}
+		c->next = a->chunk;
+		a->chunk = c;
+		a->pool += CHUNK_SIZE;
+		a->ptr = (char *)(c + 1);
+		a->end = (char *)c + CHUNK_SIZE;
+	}
+	void * ret = a->ptr;
+	a->ptr += csz;
+	return ret;
+}
+
+static inline void
+pool_free(struct hive_alloc *a, void *ptr, size_t sz) {
+	int idx = SIZE_INDEX(sz);
+	struct free_node * node = ptr;
+	node->next = a->free[idx];
+	a->free[idx] = node;
+}
+
+//lua_Alloc, Сڴʧ
+static void *
+lalloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+	struct hive_alloc * a = ud;
+	if (ptr == NULL) {
+		//ʱ osize Ƕ
+		osize = 0;
+	}
+	if (nsize == 0) {
+		if (ptr) {
+			a->used -= osize;
+			if (osize <= MAX_SMALL) {
+				pool_free(a, ptr, osize);
+			} else {
+				free(ptr);
+			}
+		}
+		return NULL;
+	}
+	if (nsize > osize && a->limit && a->used + (nsize - osize) > a->limit) {
+		//,ֻ cell ķʧ
+		return NULL;
+	}
+	void * ret;
+	if (ptr == NULL) {
+		ret = nsize <= MAX_SMALL ? pool_alloc(a, nsize) : malloc(nsize);
+	} else if (osize > MAX_SMALL && nsize > MAX_SMALL) {
+		ret = realloc(ptr, nsize);
+	} else if (osize <= MAX_SMALL && nsize <= MAX_SMALL && SIZE_INDEX(osize) == SIZE_INDEX(nsize)) {
+		ret = ptr;
+	} else {
+		ret = nsize <= MAX_SMALL ? pool_alloc(a, nsize) : malloc(nsize);
+		if (ret == NULL) {
+			if (nsize < osize) {
+				//СʧʱʹԭĿ, Ժᰴ nsize Żؿ
+				a->used -= osize - nsize;
+				return ptr;
+			}
+			return NULL;
+		}
+		memcpy(ret, ptr, osize < nsize ? osize : nsize);
+		if (osize <= MAX_SMALL) {
+			pool_free(a, ptr, osize);
+		} else {
+			free(ptr);
+		}
+	}
+	if (ret) {
+		a->used += nsize;
+		a->used -= osize;
+	}
+	return ret;
+}
+
+// luaL_newstate һ
+static int
+panic(lua_State *L) {
+	fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+	return 0;
+}
+
+//ʹԼķ lua_State
+lua_State *
+hive_newstate(void) {
+	struct hive_alloc * a = malloc(sizeof(*a));
+	memset(a, 0, sizeof(*a));
+	a->limit = __default_limit;
+	lua_State *L = lua_newstate(lalloc, a);
+	if (L == NULL) {
+		free(a);
+		return NULL;
+	}
+	lua_atpanic(L, panic);
+	alloc_lock();
+	a->next = __alloc_list;
+	if (__alloc_list) {
+		__alloc_list->prev = a;
+	}
+	__alloc_list = a;
+	alloc_unlock();
+	return L;
+}
+
+//ر lua_State, ͷе chunk
+void
+hive_closestate(lua_State *L) {
+	void * ud = NULL;
+	lua_getallocf(L, &ud);
+	struct hive_alloc * a = ud;
+	alloc_lock();
+	if (a->prev) {
+		a->prev->next = a->next;
+	} else {
+		__alloc_list = a->next;
+	}
+	if (a->next) {
+		a->next->prev = a->prev;
+	}
+	alloc_unlock();
+
+	lua_close(L);
+
+	struct chunk * c = a->chunk;
+	while (c) {
+		struct chunk * next = c->next;
+		free(c);
+		c = next;
+	}
+	free(a);
+}
+
+//lua_State ĸ cell, ͳ
+void
+hive_alloc_setowner(lua_State *L, void *owner) {
+	void * ud = NULL;
+	lua_getallocf(L, &ud);
+	struct hive_alloc * a = ud;
+	alloc_lock();
+	a->owner = owner;
+	alloc_unlock();
+}
+
+void
+hive_alloc_setdefault(size_t limit) {
+	__default_limit = limit;
+}
+
+// cell ڴ, Ҳ false
+bool
+hive_alloc_setlimit(void *owner, size_t limit) {
+	bool ret = false;
+	alloc_lock();
+	struct hive_alloc * a;
+	for (a = __alloc_list; a; a = a->next) {
+		if (a->owner == owner) {
+			a->limit = limit;
+			ret = true;
+			break;
+		}
+	}
+	alloc_unlock();
+	return ret;
+}
+
+//ռ cell ڴʹ, ص cell ,Ҫ cell_release
+//رе cell ͳ. صҪ free
+int
+hive_alloc_collect(struct hive_alloc_info **info) {
+	int cap = 64;
+	int n = 0;
+	struct hive_alloc_info * r = malloc(cap * sizeof(*r));
+	alloc_lock();
+	struct hive_alloc * a;
+	for (a = __alloc_list; a; a = a->next) {
+		//owner  cell رʱͷ,  alloc_lock ʱ owner ָ cell û
+		if (a->owner == NULL || !cell_grabalive(a->owner)) {
+			continue;
+		}
+		if (n >= cap) {
+			cap *= 2;
+			r = realloc(r, cap * sizeof(*r));
+		}
+		r[n].owner = a->owner;
+		r[n].used = a->used;
+		r[n].pool = a->pool;
+		r[n].limit = a->limit;
+		++n;
+	}
+	alloc_unlock();
+	*info = r;
+	return n;
+}
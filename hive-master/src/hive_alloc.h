@@ -0,0 +1,23 @@
+#ifndef hive_alloc_h
+#define hive_alloc_h
+
+#include "lua.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+
+struct hive_alloc_info {
+	void * owner;
+	size_t used;
+	size_t pool;
+	size_t limit;
+};
+
+lua_State * hive_newstate(void);
+void hive_closestate(lua_State *L);
+void hive_alloc_setowner(lua_State *L, void *owner);
+void hive_alloc_setdefault(size_t limit);
+bool hive_alloc_setlimit(void *owner, size_t limit);
+int hive_alloc_collect(struct hive_alloc_info **info);
+
+#endif
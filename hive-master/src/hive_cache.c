@@ -0,0 +1,182 @@
+#include "lua.h"
+#include "lauxlib.h"
+#include "hive_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//ڹֽ뻺, ͬһļֻȡͱһ, ֮ cell ֱӴ lua_dump Ľ
+//ģӦļ·Ҳ, ÿģֻ package.path вһ
+
+struct cache_entry {
+	struct cache_entry * next;
+	int ref;
+	size_t sz;
+	char * code;
+	char * name;
+};
+
+//ֽ뻺, name ļ, code  lua_dump Ľ
+static struct cache_entry * __cache = NULL;
+//·, name ģ, code ļ
+static struct cache_entry * __path = NULL;
+static int __cache_lock = 0;
+
+static inline void
+cache_lock(void) {
+	while (__sync_lock_test_and_set(&__cache_lock,1)) {}
+}
+
+static inline void
+cache_unlock(void) {
+	__sync_lock_release(&__cache_lock);
+}
+
+static void
+entry_release(struct cache_entry *e) {
+	if (__sync_sub_and_fetch(&e->ref, 1) == 0) {
+		free(e->code);
+		free(e->name);
+		free(e);
+	}
+}
+
+//ҵ entry , ʱҪ
+static struct cache_entry *
+cache_grab(struct cache_entry **list, const char *name) {
+	cache_lock();
+	struct cache_entry * e;
+	for (e = *list; e; e = e->next) {
+		if (strcmp(e->name, name) == 0) {
+			__sync_add_and_fetch(&e->ref, 1);
+			break;
+		}
+	}
+	cache_unlock();
+	return e;
+}
+
+static void
+cache_insert(struct cache_entry **list, const char *name, char *code, size_t sz) {
+	struct cache_entry * e = malloc(sizeof(*e));
+	e->ref = 1;
+	e->sz = sz;
+	e->code = code;
+	size_t len = strlen(name);
+	e->name = malloc(len + 1);
+	memcpy(e->name, name, len + 1);
+	cache_lock();
+	struct cache_entry * p;
+	for (p = *list; p; p = p->next) {
+		if (strcmp(p->name, name) == 0) {
+			//߳ѾŽȥ
+			break;
+		}
+	}
+	if (p == NULL) {
+		e->next = *list;
+		*list = e;
+	}
+	cache_unlock();
+	if (p) {
+		entry_release(e);
+	}
+}
+
+struct dump_buffer {
+	char * ptr;
+	size_t sz;
+	size_t cap;
+};
+
+static int
+writer(lua_State *L, const void *p, size_t sz, void *ud) {
+	struct dump_buffer * b = ud;
+	if (b->sz + sz > b->cap) {
+		size_t cap = b->cap ? b->cap * 2 : 4096;
+		while (cap < b->sz + sz) {
+			cap *= 2;
+		}
+		char * ptr = realloc(b->ptr, cap);
+		if (ptr == NULL) {
+			return 1;
+		}
+		b->ptr = ptr;
+		b->cap = cap;
+	}
+	memcpy(b->ptr + b->sz, p, sz);
+	b->sz += sz;
+	return 0;
+}
+
+// luaL_loadfile һ, ѱõ chunk ѹջ, ʱѹϢ
+int
+hive_loadfile(lua_State *L, const char *filename) {
+	struct cache_entry * e = cache_grab(&__cache, filename);
+	if (e) {
+		int err = luaL_loadbuffer(L, e->code, e->sz, e->name);
+		entry_release(e);
+		return err;
+	}
+	int err = luaL_loadfile(L, filename);
+	if (err) {
+		return err;
+	}
+	struct dump_buffer b = { NULL, 0, 0 };
+	if (lua_dump(L, writer, &b) == 0) {
+		cache_insert(&__cache, filename, b.ptr, b.sz);
+	} else {
+		free(b.ptr);
+	}
+	return LUA_OK;
+}
+
+// L е package.searchpath ģ name Ӧļ, ļѹջ
+//Ҳʱ NULL, ջ
+const char *
+hive_searchpath(lua_State *L, const char *name) {
+	struct cache_entry * e = cache_grab(&__path, name);
+	if (e) {
+		lua_pushlstring(L, e->code, e->sz);
+		entry_release(e);
+		return lua_tostring(L, -1);
+	}
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "searchpath");
+	lua_pushstring(L, name);
+	lua_getfield(L, -3, "path");
+	lua_call(L, 2, 1);
+	lua_replace(L, -2);
+	if (!lua_isstring(L, -1)) {
+		lua_pop(L, 1);
+		return NULL;
+	}
+	size_t sz = 0;
+	const char * filename = lua_tolstring(L, -1, &sz);
+	char * path = malloc(sz + 1);
+	memcpy(path, filename, sz + 1);
+	cache_insert(&__path, name, path, sz);
+	return filename;
+}
+
+static void
+list_clear(struct cache_entry *e) {
+	while (e) {
+		struct cache_entry * next = e->next;
+		entry_release(e);
+		e = next;
+	}
+}
+
+//ļ޸ĺ, ʹõ entry ڼͷ
+void
+hive_cache_clear(void) {
+	cache_lock();
+	struct cache_entry * e = __cache;
+	struct cache_entry * p = __path;
+	__cache = NULL;
+	__path = NULL;
+	cache_unlock();
+	list_clear(e);
+	list_clear(p);
+}
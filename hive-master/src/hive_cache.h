@@ -0,0 +1,10 @@
+#ifndef hive_cache_h
+#define hive_cache_h
+
+#include "lua.h"
+
+int hive_loadfile(lua_State *L, const char *filename);
+void hive_cache_clear(void);
+const char * hive_searchpath(lua_State *L, const char *name);
+
+#endif
@@ -6,13 +6,23 @@
 #include "hive_seri.h"
 #include "hive_scheduler.h"
 #include "hive_socket_lib.h"
+#include "hive_alloc.h"
+#include "hive_cache.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
 
 #define DEFAULT_QUEUE 64
+#define DEFAULT_CANCEL 64
+//Ź count hook ÿִжָһ
+#define WATCHDOG_COUNT 10000
+//ȡ session ʱȫ, ֮ٵĻظ lua 㶪
+#define MAX_CANCEL 4096
 
 //Ϣ
 struct message {
@@ -32,6 +42,7 @@ struct message_queue {
 //һѭϢ
 struct cell {
 	int lock;
+	int running;	//ڱĳִ߳, ֱл(handoff)ʱ cell ܲǴȫֶȡ
 	
 	//ü
 	int ref;
@@ -39,6 +50,15 @@ struct cell {
 	struct message_queue mq; //ѭϢ
 	bool quit;			//Ƿ˳
 	bool close;
+
+	//Ѿȡ(ʱ)ĵõ session, Ѱַɢб, 0 ʾλ
+	//ٵĻظ cell_send ȡʱֱӶ,ύ lua
+	double *cancel;
+	int cancel_n;
+	int cancel_cap;
+
+	int gc_active;	//Ϣ,ȴ߳̿ʱ gc
+	int gc_step;	//ʱÿ gc Ĳ,μ lua_gc LUA_GCSTEP
 };
 
 struct cell_ud {
@@ -48,12 +68,76 @@ struct cell_ud {
 static int __cell =0;
 #define CELL_TAG (&__cell)
 
+//cellеϢ,Լǿյcell,ڹƸ
+//̷ֿ߳,ÿϢдͬһ cacheline. Ϣһ߳з,һ߳ȡ,
+//̵߳ļǸ,ֻ cell_load еܺ
+//߳ LOAD_SLOT ʱṲü, ȻԭӲ
+#define LOAD_SLOT 64
+struct load_counter {
+	int pending;
+	int runnable;
+	char pad[64 - 2 * sizeof(int)];
+};
+
+static struct load_counter __load[LOAD_SLOT] __attribute__((aligned(64)));
+static int __load_n = 0;
+static __thread struct load_counter * __load_local = NULL;
+
+static inline struct load_counter *
+load_counter(void) {
+	struct load_counter * lc = __load_local;
+	if (lc == NULL) {
+		lc = &__load[__sync_fetch_and_add(&__load_n, 1) % LOAD_SLOT];
+		__load_local = lc;
+	}
+	return lc;
+}
+
+//߳һε(port 2)߻ظ(port 1)Ŀcell, 
+//ֻĿԭΪʱ¼, __handoff_msg Ϣ
+//ǰϢֱִ߳,õȫֵֶ
+static __thread struct cell * __handoff = NULL;
+static __thread void * __handoff_msg = NULL;
+static __thread bool __handoff_enable = false;
+
+//Ź: Ϣʱ()ָԤʱ,ѡֹ, 0 ʾ
+// hive.start ,޸
+static int __budget_time = 0;
+static uint64_t __budget_count = 0;
+static bool __budget_abort = false;
+
+//ǰ߳ڴϢ
+struct dispatch_info {
+	struct cell * c;
+	int port;
+	uint64_t start;		//ʼʱ,΢
+	uint64_t count;		//Ѿִеָ, WATCHDOG_COUNT Ϊλ, ʱʱ int 
+	bool reported;
+};
+
+static __thread struct dispatch_info * __dispatch = NULL;
+
 //ȡcell,ü
 void
 cell_grab(struct cell *c) {
 	__sync_add_and_fetch(&c->ref,1);
 }
 
+//ֻ cell ûйرղһʱü, ɹ true
+//ڴӲõĵط(ڴͳ)ȡ cell
+bool
+cell_grabalive(struct cell *c) {
+	for (;;) {
+		int ref = c->ref;
+		if (ref <= 0 || c->close || c->quit) {
+			return false;
+		}
+		if (__sync_bool_compare_and_swap(&c->ref, ref, ref + 1)) {
+			return true;
+		}
+	}
+}
+
 //ͷcell,ü-1
 void
 cell_release(struct cell *c) {
@@ -177,6 +261,11 @@ mq_init(struct message_queue *mq) {
 //ϢϢ
 static void
 mq_push(struct message_queue *mq, struct message *m) {
+	struct load_counter * lc = load_counter();
+	if (mq->head == mq->tail) {
+		__sync_add_and_fetch(&lc->runnable, 1);
+	}
+	__sync_add_and_fetch(&lc->pending, 1);
 	mq->queue[mq->tail] = *m;
 	++mq->tail;
 	//Ϊѭ
@@ -215,6 +304,11 @@ mq_pop(struct message_queue *mq, struct message *m) {
 	if (mq->head >= mq->cap) {
 		mq->head = 0;
 	}
+	struct load_counter * lc = load_counter();
+	__sync_sub_and_fetch(&lc->pending, 1);
+	if (mq->head == mq->tail) {
+		__sync_sub_and_fetch(&lc->runnable, 1);
+	}
 	return 0;
 }
 
@@ -224,10 +318,16 @@ static struct cell *
 cell_create() {
 	struct cell *c = malloc(sizeof(*c));
 	c->lock = 0;
+	c->running = 0;
 	c->ref = 0;
 	c->L = NULL;
 	c->quit = false;
 	c->close = false;
+	c->cancel = NULL;
+	c->cancel_n = 0;
+	c->cancel_cap = 0;
+	c->gc_active = 0;
+	c->gc_step = 0;
 
 	//ʼѭϢ
 	mq_init(&c->mq);
@@ -239,7 +339,15 @@ cell_create() {
 static void
 cell_destroy(struct cell *c) {
 	assert(c->ref == 0);
+	//ûдϢټ븺
+	int n = (c->mq.tail - c->mq.head + c->mq.cap) % c->mq.cap;
+	if (n) {
+		struct load_counter * lc = load_counter();
+		__sync_sub_and_fetch(&lc->pending, n);
+		__sync_sub_and_fetch(&lc->runnable, 1);
+	}
 	free(c->mq.queue);
+	free(c->cancel);
 	assert(c->L == NULL);
 	free(c);
 }
@@ -303,12 +411,108 @@ lcallback(lua_State *L) {
 }
 
 
+static uint64_t
+_gettime_us(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+//ÿŹ, time Ǻ, count ָ
+void
+cell_watchdog(int time, uint64_t count, bool abort) {
+	__budget_time = time;
+	__budget_count = count;
+	__budget_abort = abort;
+}
+
+//count hook, Э̴ʱ̳, cell еЭ̶
+static void
+watchdog_hook(lua_State *L, lua_Debug *ar) {
+	struct dispatch_info * d = __dispatch;
+	if (d == NULL) {
+		return;
+	}
+	d->count += WATCHDOG_COUNT;
+	bool over = __budget_count && d->count >= __budget_count;
+	int elapsed = 0;
+	if (__budget_time) {
+		elapsed = (int)((_gettime_us() - d->start) / 1000);
+		if (elapsed >= __budget_time) {
+			over = true;
+		}
+	}
+	if (!over) {
+		return;
+	}
+	if (!d->reported) {
+		d->reported = true;
+		char msg[128];
+		snprintf(msg, sizeof(msg), "[cell %p] port %d runs %d ms, %llu instructions, over budget", d->c, d->port, elapsed, (unsigned long long)d->count);
+		luaL_traceback(L, L, msg, 0);
+		printf("%s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
+	//ֹֻЭ. ߳е cell.lua ĵȴ(suspend deliver_event),ֹƻ״̬
+	if (__budget_abort) {
+		int main = lua_pushthread(L);
+		lua_pop(L, 1);
+		if (!main) {
+			luaL_error(L, "[cell %p] dispatch aborted by watchdog", d->c);
+		}
+	}
+}
+
+// C ģ鲢ջ, Ԥȴ lua_State Ѿعֱʹ
+static void
+requirelib(lua_State *L, const char *name, lua_CFunction f) {
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, "_LOADED");
+	lua_getfield(L, -1, name);
+	lua_remove(L, -2);
+	if (lua_isnil(L, -1)) {
+		lua_pop(L, 1);
+		luaL_requiref(L, name, f, 0);
+	}
+}
+
+//Ԥȼ cell.c  cell.c.socket, Ԥȴ lua_State
+void
+cell_preload(lua_State *L) {
+	requirelib(L, "cell.c.socket", socket_lib);
+	requirelib(L, "cell.c", cell_lib);
+	lua_pop(L, 2);
+}
+
+static struct cell * _cell_new(lua_State *L, const char * mainfile);
+
 //mainfileӦ  system.lua
+//һ cell Ϣʱ(c.launch),  cell  main chunk ߵĿŹԤ
 struct cell *
 cell_new(lua_State *L, const char * mainfile) {
+	struct dispatch_info * d = __dispatch;
+	if (d == NULL) {
+		return _cell_new(L, mainfile);
+	}
+	__dispatch = NULL;
+	uint64_t start = __budget_time ? _gettime_us() : 0;
+	struct cell * c = _cell_new(L, mainfile);
+	if (__budget_time) {
+		//ѵʱҲ
+		d->start += _gettime_us() - start;
+	}
+	__dispatch = d;
+	return c;
+}
+
+static struct cell *
+_cell_new(lua_State *L, const char * mainfile) {
+
+	if (__budget_time || __budget_count) {
+		lua_sethook(L, watchdog_hook, LUA_MASKCOUNT, WATCHDOG_COUNT);
+	}
 
 	//þǵsocket_libȻѸģ󶨵cell.c.socketģ,Ὣģĸջ
-	luaL_requiref(L, "cell.c.socket", socket_lib, 0);
+	requirelib(L, "cell.c.socket", socket_lib);
 
 	
 	lua_pop(L,1);
@@ -320,7 +524,7 @@ cell_new(lua_State *L, const char * mainfile) {
 	int cell_map = lua_absindex(L,-1);	// cell_map
 
 	//cell_lib
-	luaL_requiref(L, "cell.c", cell_lib, 0);	// cell_map cell_lib
+	requirelib(L, "cell.c", cell_lib);	// cell_map cell_lib
 
 	//cell
 	struct cell * c = cell_create();
@@ -344,7 +548,8 @@ cell_new(lua_State *L, const char * mainfile) {
 	hive_setenv(L, "cell_pointer");
 
 	//mainfileеĴ룬chunk,ѹջ Ӧļhive/system.lua
-	int err = luaL_loadfile(L, mainfile);
+	//ͬһļֻһ,֮ӻֽ
+	int err = hive_loadfile(L, mainfile);
 	
 	if (err) {
 		printf("%d : %s\n", err, lua_tostring(L,-1));
@@ -376,6 +581,7 @@ cell_new(lua_State *L, const char * mainfile) {
 	//һµ C հѹջ  n ֮жٸֵҪ
 	//lcallbackϢ
 	lua_pushcclosure(L, lcallback, 5);
+	hive_alloc_setowner(L, c);
 	return c;
 _error:
 	scheduler_deletetask(L);
@@ -395,7 +601,16 @@ cell_close(struct cell *c) {
 
 //ôϢĺ
 static void
-_dispatch(lua_State *L, struct message *m) {
+_dispatch(struct cell *c, lua_State *L, struct message *m) {
+	struct dispatch_info d;
+	if (__budget_time || __budget_count) {
+		d.c = c;
+		d.port = m->port;
+		d.start = __budget_time ? _gettime_us() : 0;
+		d.count = 0;
+		d.reported = false;
+		__dispatch = &d;
+	}
 	//lua_pushvalue() ջϸԪһѹջ
 	//ӦǽҪõĺջ
 	lua_pushvalue(L, 1);	// dup callback
@@ -405,6 +620,55 @@ _dispatch(lua_State *L, struct message *m) {
 
 	//һ
 	lua_call(L, 2, 0);
+	__dispatch = NULL;
+}
+
+static inline int
+cancel_hash(double session, int cap) {
+	uint64_t h = (uint64_t)session * 0x9E3779B97F4A7C15ull;
+	return (int)(h >> 32) & (cap - 1);
+}
+
+static void
+cancel_insert(struct cell *c, double session) {
+	int i = cancel_hash(session, c->cancel_cap);
+	while (c->cancel[i] != 0) {
+		if (c->cancel[i] == session) {
+			return;
+		}
+		i = (i + 1) & (c->cancel_cap - 1);
+	}
+	c->cancel[i] = session;
+	++c->cancel_n;
+}
+
+//ʱΪ -1 ,̽Ͽ
+static bool
+cancel_remove(struct cell *c, double session) {
+	int i = cancel_hash(session, c->cancel_cap);
+	while (c->cancel[i] != 0) {
+		if (c->cancel[i] == session) {
+			c->cancel[i] = -1;
+			return true;
+		}
+		i = (i + 1) & (c->cancel_cap - 1);
+	}
+	return false;
+}
+
+//ȡĵõĻظֱӶ,ǰҪ c->lock
+//ʱѾеĻظȡʱ
+static bool
+cancel_drop(struct cell *c, struct message *m) {
+	if (m->port == 1 && c->cancel_n > 0) {
+		// HIVE_PORT 1 : response , һֵ session
+		double session;
+		if (data_peeknumber(m->buffer, &session) && cancel_remove(c, session)) {
+			data_free(m->buffer);
+			return true;
+		}
+	}
+	return false;
 }
 
 //е ѭϢеϢԣ_dispatch
@@ -414,7 +678,7 @@ trash_msg(lua_State *L, struct cell *c) {
 	// don't need lock c later
 	struct message m;
 	while (!mq_pop(&c->mq, &m)) {
-		_dispatch(L, &m);
+		_dispatch(c, L, &m);
 	}
 	
 	// HIVE_PORT 5 : exit 
@@ -424,13 +688,14 @@ trash_msg(lua_State *L, struct cell *c) {
 	m.buffer = NULL;
 
 	
-	_dispatch(L, &m);
+	_dispatch(c, L, &m);
 }
 
 
 //ѭϢ ȡϢ,_dispatch()
-int 
-cell_dispatch_message(struct cell *c) {
+//expect Ϊ NULL ʱֻλڶͷϢ
+static int
+_dispatch_message(struct cell *c, void *expect) {
 	cell_lock(c);
 	lua_State *L = c->L;
 	
@@ -447,12 +712,20 @@ cell_dispatch_message(struct cell *c) {
 		cell_unlock(c);
 		
 		trash_msg(L,c);
+		//üܽ 0 ֮ǰ cell Ĺ, ڴͳƲȡ
+		hive_alloc_setowner(L, NULL);
 		cell_release(c);
 		scheduler_deletetask(L);
 
 		return CELL_EMPTY;
 	}
 
+	//ֱлʱ,¼ϢѾ̴߳˾ͲٴϢ
+	if (expect && (c->mq.head == c->mq.tail || c->mq.queue[c->mq.head].buffer != expect)) {
+		cell_unlock(c);
+		return CELL_EMPTY;
+	}
+
 	//ѭϢ ȡϢ
 	struct message m;
 	int empty = mq_pop(&c->mq, &m);
@@ -462,18 +735,165 @@ cell_dispatch_message(struct cell *c) {
 		cell_unlock(c);
 		return CELL_EMPTY;
 	} 
+	if (cancel_drop(c, &m)) {
+		cell_unlock(c);
+		return CELL_MESSAGE;
+	}
 	cell_grab(c);
 	
 	cell_unlock(c);
 
 	//
-	_dispatch(L,&m);
+	_dispatch(c, L, &m);
 
 	cell_release(c);
 
 	return CELL_MESSAGE;
 }
 
+//ͬһʱֻһִ߳ cell, ڱִ߳ʱûϢ
+int
+cell_dispatch_message(struct cell *c) {
+	if (!__sync_bool_compare_and_swap(&c->running, 0, 1)) {
+		return CELL_EMPTY;
+	}
+	int r = _dispatch_message(c, NULL);
+	if (r != CELL_QUIT) {
+		__sync_lock_release(&c->running);
+	}
+	return r;
+}
+
+//ֱлʱ¼Ϣ msg, Ѿڶͷʱ CELL_EMPTY
+int
+cell_dispatch_handoff(struct cell *c, void *msg) {
+	if (!__sync_bool_compare_and_swap(&c->running, 0, 1)) {
+		return CELL_EMPTY;
+	}
+	int r = _dispatch_message(c, msg);
+	if (r != CELL_QUIT) {
+		__sync_lock_release(&c->running);
+	}
+	return r;
+}
+
+// cell Ϣ,  true ʾ֮ǰûбǹ,Ҫ¼
+bool
+cell_gcactive(struct cell *c) {
+	return __sync_bool_compare_and_swap(&c->gc_active, 0, 1);
+}
+
+static int
+lgcstep(lua_State *L) {
+	lua_pushboolean(L, lua_gc(L, LUA_GCSTEP, lua_tointeger(L, 1)));
+	return 1;
+}
+
+//߳̿ʱ,  cell һ gc
+// 0 ʾһ gc û, -1 ʾ cell ִ, 1 ʾ( cell Ѿر)
+int
+cell_gcstep(struct cell *c) {
+	if (!__sync_bool_compare_and_swap(&c->running, 0, 1)) {
+		return -1;
+	}
+	cell_lock(c);
+	lua_State *L = c->L;
+	bool closed = c->close || c->quit;
+	cell_unlock(c);
+	int r = 1;
+	if (L && !closed) {
+		// __gc Ԫܳ, Ҫڱģʽִ
+		lua_pushcfunction(L, lgcstep);
+		lua_pushinteger(L, c->gc_step);
+		if (lua_pcall(L, 1, 1, 0) == LUA_OK) {
+			r = lua_toboolean(L, -1);
+		} else {
+			printf("[cell %p] gc error : %s\n", c, lua_tostring(L, -1));
+		}
+		lua_pop(L, 1);
+	}
+	if (r) {
+		c->gc_active = 0;
+	}
+	__sync_lock_release(&c->running);
+	return r;
+}
+
+//ÿʱ gc Ĳ
+void
+cell_setgcstep(struct cell *c, int step) {
+	c->gc_step = step;
+}
+
+//ڹ߳е,̷֮߳ĵúͻظ¼Ŀcell
+void
+cell_handoff_start(void) {
+	__handoff_enable = true;
+}
+
+//ȡ¼ĿcellϢ, Ҫ cell_release
+struct cell *
+cell_handoff(void **msg) {
+	struct cell * c = __handoff;
+	*msg = __handoff_msg;
+	__handoff = NULL;
+	__handoff_msg = NULL;
+	return c;
+}
+
+static void
+handoff_set(struct cell *c, void *msg) {
+	cell_grab(c);
+	struct cell * last = __handoff;
+	__handoff = c;
+	__handoff_msg = msg;
+	if (last) {
+		cell_release(last);
+	}
+}
+
+//ȡһ,֮ session ӦĻظᱻ
+void
+cell_cancel(struct cell *c, double session) {
+	cell_lock(c);
+	if (c->cancel_n >= MAX_CANCEL) {
+		memset(c->cancel, 0, c->cancel_cap * sizeof(double));
+		c->cancel_n = 0;
+	}
+	if (c->cancel_n * 2 >= c->cancel_cap) {
+		//һµװ
+		int i;
+		double * old = c->cancel;
+		int old_cap = c->cancel_cap;
+		c->cancel_cap = old_cap ? old_cap * 2 : DEFAULT_CANCEL;
+		c->cancel = calloc(c->cancel_cap, sizeof(double));
+		c->cancel_n = 0;
+		for (i=0;i<old_cap;i++) {
+			if (old[i] > 0) {
+				cancel_insert(c, old[i]);
+			}
+		}
+		free(old);
+	}
+	cancel_insert(c, session);
+	cell_unlock(c);
+}
+
+//ͳ: еϢ, Ϣcell
+//ֻ poll ʱ, Ѹ̵߳ļ, ֻǽֵ
+void
+cell_load(int *pending, int *runnable) {
+	int p = 0;
+	int r = 0;
+	int i;
+	for (i=0;i<LOAD_SLOT;i++) {
+		p += __load[i].pending;
+		r += __load[i].runnable;
+	}
+	*pending = p > 0 ? p : 0;
+	*runnable = r > 0 ? r : 0;
+}
+
 //ϢǽϢӵcellеѭϢ
 int 
 cell_send(struct cell *c, int port, void *msg) {
@@ -483,7 +903,15 @@ cell_send(struct cell *c, int port, void *msg) {
 		return 1;
 	}
 	struct message m = { port, msg };
+	if (cancel_drop(c, &m)) {
+		cell_unlock(c);
+		return 0;
+	}
+	bool empty = c->mq.head == c->mq.tail;
 	mq_push(&c->mq, &m);
 	cell_unlock(c);
+	if (empty && (port == 1 || port == 2) && __handoff_enable) {
+		handoff_set(c, msg);
+	}
 	return 0;
 }
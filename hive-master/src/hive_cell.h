@@ -3,6 +3,9 @@
 
 #include "lua.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
 struct cell;
 
 #define CELL_MESSAGE 0
@@ -10,12 +13,23 @@ struct cell;
 #define CELL_QUIT 2
 
 struct cell * cell_new(lua_State *L, const char * mainfile);
+void cell_preload(lua_State *L);
 int cell_dispatch_message(struct cell *c);
+int cell_dispatch_handoff(struct cell *c, void *msg);
 int cell_send(struct cell *c, int port, void *msg);
 void cell_touserdata(lua_State *L, int index, struct cell *c);
 struct cell * cell_fromuserdata(lua_State *L, int index);
 void cell_grab(struct cell *c);
+bool cell_grabalive(struct cell *c);
 void cell_release(struct cell *c);
 void cell_close(struct cell *c);
+void cell_load(int *pending, int *runnable);
+void cell_cancel(struct cell *c, double session);
+void cell_handoff_start(void);
+void cell_watchdog(int time, uint64_t count, bool abort);
+bool cell_gcactive(struct cell *c);
+int cell_gcstep(struct cell *c);
+void cell_setgcstep(struct cell *c, int step);
+struct cell * cell_handoff(void **msg);
 
 #endif
@@ -3,6 +3,8 @@
 #include "hive_seri.h"
 #include "hive_cell.h"
 #include "hive_seri.h"
+#include "hive_scheduler.h"
+#include "hive_cache.h"
 
 #include "lua.h"
 #include "lauxlib.h"
@@ -52,6 +54,52 @@ lsend(lua_State *L) {
 	return 0;
 }
 
+//ȡԼĵ, ֮ session ӦĻظֱ C ж
+static int
+lcancel(lua_State *L) {
+	double session = luaL_checknumber(L, 1);
+	hive_getenv(L, "cell_pointer");
+	struct cell * c = lua_touserdata(L, -1);
+	if (c == NULL) {
+		return luaL_error(L, "No cell");
+	}
+	cell_cancel(c, session);
+	return 0;
+}
+
+//ù߳̿ʱ cell  gc Ĳ
+static int
+lgcstep(lua_State *L) {
+	int step = luaL_checkinteger(L, 1);
+	hive_getenv(L, "cell_pointer");
+	struct cell * c = lua_touserdata(L, -1);
+	if (c == NULL) {
+		return luaL_error(L, "No cell");
+	}
+	cell_setgcstep(c, step);
+	return 0;
+}
+
+//ڵǰĹ߳д cell, Ҫ system cell, ͬ cell ͬʱ
+//ģ,  package.path в
+static int
+llaunch(lua_State *L) {
+	const char * name = luaL_checkstring(L,1);
+	const char * filename = hive_searchpath(L, name);
+	if (filename == NULL) {
+		return luaL_error(L, "cell %s was not found", name);
+	}
+	lua_State *sL = scheduler_newtask(L, scheduler_libs(L, 2));
+	struct cell * c = cell_new(sL, filename);
+	if (c == NULL) {
+		return 0;
+	}
+	hive_getenv(L, "cell_map");
+	cell_touserdata(L, lua_gettop(L), c);
+	scheduler_starttask(sL);
+	return 1;
+}
+
 //עắ
 int
 cell_lib(lua_State *L) {
@@ -59,6 +107,9 @@ cell_lib(lua_State *L) {
 	luaL_Reg l[] = {
 		{ "dispatch", ldispatch },
 		{ "send", lsend },
+		{ "cancel", lcancel },
+		{ "gcstep", lgcstep },
+		{ "launch", llaunch },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L,l);
@@ -5,6 +5,7 @@
 #include "hive_env.h"
 #include "hive_scheduler.h"
 #include "hive_system_lib.h"
+#include "hive_alloc.h"
 
 #include <stdint.h>
 #include <stdio.h>
@@ -17,6 +18,10 @@
 #define DEFAULT_THREAD 4
 #define MAX_GLOBAL_MQ 0x10000
 #define GP(p) ((p) % MAX_GLOBAL_MQ)
+//һֱлĴ,һԻõcellռס߳
+#define MAX_HANDOFF 16
+//ÿ߳¼ٸȴʱ gc cell
+#define MAX_GC_CELL 256
 
 //ȫֵϢ,洢cellָ룬cellԼѭϢ
 struct global_queue {
@@ -35,6 +40,46 @@ struct global_queue {
 };
 
 
+//Ԥȴõ lua_State, ɵ̲߳
+//߳ڳʱȴ cond, ȡһʱ
+struct state_pool {
+	int size;
+	int n;
+	bool quit;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	lua_State ** L;
+};
+
+static struct state_pool __pool;
+
+//ǼصĿ, cell.lua Ҫõ
+static const luaL_Reg baselibs[] = {
+	{ "_G", luaopen_base },
+	{ LUA_LOADLIBNAME, luaopen_package },
+	{ LUA_COLIBNAME, luaopen_coroutine },
+	{ LUA_TABLIBNAME, luaopen_table },
+	{ NULL, NULL },
+};
+
+//ѡĿ, Ӧ libs еλ, ûѡڵһηʱ
+static const luaL_Reg stdlibs[] = {
+	{ LUA_STRLIBNAME, luaopen_string },
+	{ LUA_MATHLIBNAME, luaopen_math },
+	{ LUA_IOLIBNAME, luaopen_io },
+	{ LUA_OSLIBNAME, luaopen_os },
+	{ LUA_DBLIBNAME, luaopen_debug },
+#ifdef LUA_BITLIBNAME
+	{ LUA_BITLIBNAME, luaopen_bit32 },
+#endif
+	{ NULL, NULL },
+};
+
+#define LIB_ALL ((1 << (sizeof(stdlibs) / sizeof(stdlibs[0]) - 1)) - 1)
+
+//launch ʱûָ libs ʹõĿ, е lua_State Ҳ
+static int __default_libs = LIB_ALL;
+
 //ʱģ
 struct timer {
 	uint32_t current;
@@ -99,6 +144,82 @@ globalmq_dec(struct global_queue *q) {
 }
 
 
+//߳Ϣcell, , ʱ gc
+struct gc_list {
+	int n;
+	struct cell * c[MAX_GC_CELL];
+};
+
+static __thread struct gc_list * __gc = NULL;
+
+static void
+_gc_mark(struct cell *c) {
+	struct gc_list * g = __gc;
+	if (g && g->n < MAX_GC_CELL && cell_gcactive(c)) {
+		cell_grab(c);
+		g->c[g->n++] = c;
+	}
+}
+
+//߳̿ʱ,ÿ¼cellһ gc, Ƿû(ִеcell)
+static bool
+_gc_idle(void) {
+	struct gc_list * g = __gc;
+	int i;
+	int n = 0;
+	bool more = false;
+	for (i=0;i<g->n;i++) {
+		struct cell * c = g->c[i];
+		int r = cell_gcstep(c);
+		if (r > 0) {
+			cell_release(c);
+		} else {
+			more = more || r == 0;
+			g->c[n++] = c;
+		}
+	}
+	g->n = n;
+	return more;
+}
+
+static void
+_gc_clear(void) {
+	struct gc_list * g = __gc;
+	int i;
+	for (i=0;i<g->n;i++) {
+		cell_release(g->c[i]);
+	}
+	g->n = 0;
+	__gc = NULL;
+}
+
+//һϢ,˻߻ظһcell,Ǹcell,ֱִ
+//úͻظõĿcellȫֵֶ
+static void
+_handoff(void) {
+	int i;
+	void * msg;
+	for (i=0;i<MAX_HANDOFF;i++) {
+		struct cell * c = cell_handoff(&msg);
+		if (c == NULL) {
+			return;
+		}
+		//, ᷵ CELL_QUIT
+		int r = cell_dispatch_handoff(c, msg);
+		if (r == CELL_MESSAGE) {
+			_gc_mark(c);
+		}
+		cell_release(c);
+		if (r != CELL_MESSAGE) {
+			break;
+		}
+	}
+	struct cell * c = cell_handoff(&msg);
+	if (c) {
+		cell_release(c);
+	}
+}
+
 //һcellѭϢѡȡһϢ֮󽫸cell뵽β
 static int
 _message_dispatch(struct global_queue *q) {
@@ -119,8 +240,14 @@ _message_dispatch(struct global_queue *q) {
 		globalmq_dec(q);
 		return 1;
 	}
+	if (r == CELL_MESSAGE) {
+		_gc_mark(c);
+	}
 	//ֽcell뵽qй
 	globalmq_push(q, c);
+	if (r == CELL_MESSAGE) {
+		_handoff();
+	}
 	return r;
 }
 
@@ -188,10 +315,199 @@ _timer(void *p) {
 }
 
 
+//ûԤȼصĿ, ɹʱջ 1
+static int
+_lazy_load(lua_State *L, const char *name) {
+	int i;
+	for (i=0;stdlibs[i].func;i++) {
+		if (strcmp(stdlibs[i].name, name) == 0) {
+			luaL_requiref(L, name, stdlibs[i].func, 1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//_G  __index , һηʿʱ, غ _G , Ժپ
+static int
+_lazy_index(lua_State *L) {
+	if (lua_type(L, 2) != LUA_TSTRING) {
+		return 0;
+	}
+	return _lazy_load(L, lua_tostring(L, 2));
+}
+
+//package.preload е loader,  require "os" д
+static int
+_lazy_require(lua_State *L) {
+	return _lazy_load(L, luaL_checkstring(L,1));
+}
+
+//string ûмʱַ __index,  string ʱ滻ַԪ
+static int
+_lazy_string(lua_State *L) {
+	_lazy_load(L, LUA_STRLIBNAME);
+	lua_pushvalue(L, 2);
+	lua_gettable(L, -2);
+	return 1;
+}
+
+//ֻ libs ѡı׼, ڵһηʱ
+static void
+_openlibs(lua_State *L, int libs) {
+	const luaL_Reg *lib;
+	for (lib = baselibs; lib->func; lib++) {
+		luaL_requiref(L, lib->name, lib->func, 1);
+		lua_pop(L, 1);
+	}
+	if (libs == LIB_ALL) {
+		for (lib = stdlibs; lib->func; lib++) {
+			luaL_requiref(L, lib->name, lib->func, 1);
+			lua_pop(L, 1);
+		}
+		return;
+	}
+	lua_pushglobaltable(L);
+	lua_newtable(L);
+	lua_pushcfunction(L, _lazy_index);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
+	lua_pop(L, 1);
+
+	luaL_getsubtable(L, LUA_REGISTRYINDEX, "_PRELOAD");
+	int i;
+	for (i=0;stdlibs[i].func;i++) {
+		if (libs & (1 << i)) {
+			luaL_requiref(L, stdlibs[i].name, stdlibs[i].func, 1);
+			lua_pop(L, 1);
+		} else {
+			lua_pushcfunction(L, _lazy_require);
+			lua_setfield(L, -2, stdlibs[i].name);
+		}
+	}
+	lua_pop(L, 1);
+
+	if (!(libs & 1)) {
+		//string (stdlibs[0]), ַķҲܴ
+		lua_pushliteral(L, "");
+		lua_newtable(L);
+		lua_pushcfunction(L, _lazy_string);
+		lua_setfield(L, -2, "__index");
+		lua_setmetatable(L, -2);
+		lua_pop(L, 1);
+	}
+}
+
+// { "string", "os", ... } ת libs, nil ʾʹĬϵ
+int
+scheduler_libs(lua_State *L, int index) {
+	if (lua_isnoneornil(L, index)) {
+		return __default_libs;
+	}
+	luaL_checktype(L, index, LUA_TTABLE);
+	int libs = 0;
+	int n = lua_rawlen(L, index);
+	int i,j;
+	for (i=1;i<=n;i++) {
+		lua_rawgeti(L, index, i);
+		const char * name = luaL_checkstring(L, -1);
+		for (j=0;stdlibs[j].func;j++) {
+			if (strcmp(stdlibs[j].name, name) == 0) {
+				libs |= 1 << j;
+				break;
+			}
+		}
+		if (stdlibs[j].func == NULL) {
+			return luaL_error(L, "Unknown lib %s", name);
+		}
+		lua_pop(L, 1);
+	}
+	return libs;
+}
+
+// lua_State, ر׼ cell õ C ģ, ⲿֺ cell ޹,Ԥ
+static lua_State *
+_newstate(int libs) {
+	lua_State *L = hive_newstate();
+	_openlibs(L, libs);
+
+	//עд
+	hive_createenv(L);
+
+	lua_newtable(L);
+	lua_newtable(L);
+	//{} {} "v"
+ 	lua_pushliteral(L, "v");
+
+	//{"__mode"="v"} {}
+	lua_setfield(L, -2, "__mode");
+
+	//{"__mode"="v"  Ԫ}
+	lua_setmetatable(L,-2);
+	
+	hive_setenv(L, "cell_map");
+
+	cell_preload(L);
+
+	return L;
+}
+
+static lua_State *
+_pool_pop(void) {
+	lua_State *L = NULL;
+	//ؿʱ߳ڴ, Ҫ
+	if (__pool.n == 0) {
+		return NULL;
+	}
+	pthread_mutex_lock(&__pool.lock);
+	if (__pool.n > 0) {
+		L = __pool.L[--__pool.n];
+		pthread_cond_signal(&__pool.cond);
+	}
+	pthread_mutex_unlock(&__pool.lock);
+	return L;
+}
+
+// lua_State ص߳, ʱȴȡ, й߳˳
+static void *
+_prewarm(void *p) {
+	for (;;) {
+		pthread_mutex_lock(&__pool.lock);
+		while (__pool.n >= __pool.size && !__pool.quit) {
+			pthread_cond_wait(&__pool.cond, &__pool.lock);
+		}
+		bool quit = __pool.quit;
+		pthread_mutex_unlock(&__pool.lock);
+		if (quit) {
+			break;
+		}
+		//ʱ
+		lua_State *L = _newstate(__default_libs);
+		pthread_mutex_lock(&__pool.lock);
+		if (__pool.n < __pool.size) {
+			__pool.L[__pool.n++] = L;
+			L = NULL;
+		}
+		pthread_mutex_unlock(&__pool.lock);
+		if (L) {
+			hive_closestate(L);
+		}
+	}
+	lua_State *L;
+	while ((L = _pool_pop())) {
+		hive_closestate(L);
+	}
+	return NULL;
+}
+
 //߳
 static void *
 _worker(void *p) {
 	struct global_queue * mq = p;
+	struct gc_list gc;
+	gc.n = 0;
+	__gc = &gc;
+	cell_handoff_start();
 	for (;;) {
 		int i;
 		//cell
@@ -206,9 +522,15 @@ _worker(void *p) {
 			}
 		}
 		if (ret) {
+			//ûϢʱ gc, gc ˲˯
+			if (_gc_idle()) {
+				continue;
+			}
 			usleep(1000);
-			if (mq->total <= 1)
+			if (mq->total <= 1) {
+				_gc_clear();
 				return NULL;
+			}
 		} 
 	}
 	return NULL;
@@ -220,12 +542,16 @@ static void
 _start(struct global_queue *gmq, struct timer *t) {
 
 	int thread = gmq->thread;
-	pthread_t pid[thread+1];
+	pthread_t pid[thread+2];
 	int i;
 
 	//ʱ¼߳
 	pthread_create(&pid[0], NULL, _timer, t);
 
+	if (__pool.size > 0) {
+		pthread_create(&pid[thread+1], NULL, _prewarm, NULL);
+	}
+
 	//߳
 	for (i=1;i<=thread;i++) {
 		pthread_create(&pid[i], NULL, _worker, gmq);
@@ -235,16 +561,26 @@ _start(struct global_queue *gmq, struct timer *t) {
 	for (i=0;i<=thread;i++) {
 		pthread_join(pid[i], NULL); 
 	}
+	if (__pool.size > 0) {
+		pthread_mutex_lock(&__pool.lock);
+		__pool.quit = true;
+		pthread_cond_signal(&__pool.cond);
+		pthread_mutex_unlock(&__pool.lock);
+		pthread_join(pid[thread+1], NULL);
+	}
 }
 
 //lua,û
 lua_State *
-scheduler_newtask(lua_State *pL) {
-	lua_State *L = luaL_newstate();
-	luaL_openlibs(L);
-
-	//עд
-	hive_createenv(L);
+scheduler_newtask(lua_State *pL, int libs) {
+	//ʹԤȴõ, еĶĬϵ libs 
+	lua_State *L = NULL;
+	if (libs == __default_libs) {
+		L = _pool_pop();
+	}
+	if (L == NULL) {
+		L = _newstate(libs);
+	}
 
 	//pLעеıп"message_queue"= Lע,{"message_queue"=mq}
 	//ָͬһglobal_queue,ָ
@@ -255,26 +591,13 @@ scheduler_newtask(lua_State *pL) {
 	
 	hive_copyenv(L, pL, "system_pointer");
 
-	lua_newtable(L);
-	lua_newtable(L);
-	//{} {} "v"
- 	lua_pushliteral(L, "v");
-
-	//{"__mode"="v"} {}
-	lua_setfield(L, -2, "__mode");
-
-	//{"__mode"="v"  Ԫ}
-	lua_setmetatable(L,-2);
-	
-	hive_setenv(L, "cell_map");
-
 	return L;
 }
 
 //lua
 void
 scheduler_deletetask(lua_State *L) {
-	lua_close(L);
+	hive_closestate(L);
 }
 
 void
@@ -290,7 +613,7 @@ scheduler_starttask(lua_State *L) {
 	globalmq_push(gmq, c);
 }
 
-// luaʱݵĲ ({thread = 4,main = "test.main",},system.lua,main.lua)
+// luaʱݵĲ ({thread = 4,main = "test.main",},system.lua,"test.main")
 int 
 scheduler_start(lua_State *L) {
 	//麯һǷLUA_TTABLE
@@ -300,7 +623,7 @@ scheduler_start(lua_State *L) {
 	//Ӧhive/system.lua
 	const char * system_lua = luaL_checkstring(L,2);
 
-	//ӦҪִеļ test/main.lua
+	//main cell ģ test.main, system cell вҶӦļ
 	const char * main_lua = luaL_checkstring(L,3);
 
 	//t["thread"]ջ
@@ -312,6 +635,17 @@ scheduler_start(lua_State *L) {
 	//һԪ
 	lua_pop(L,1);
 
+	//Ź watchdog = { time = , count = ָ, abort = Ƿֹ }
+	lua_getfield(L,1, "watchdog");
+	if (lua_istable(L, -1)) {
+		lua_getfield(L, -1, "time");
+		lua_getfield(L, -2, "count");
+		lua_getfield(L, -3, "abort");
+		cell_watchdog(luaL_optinteger(L, -3, 0), (uint64_t)luaL_optnumber(L, -2, 0), lua_toboolean(L, -1));
+		lua_pop(L, 3);
+	}
+	lua_pop(L,1);
+
 	// Lעдһű
 	hive_createenv(L);
 
@@ -330,7 +664,27 @@ scheduler_start(lua_State *L) {
 	lua_State *sL;
 
 	//ٴδһlua_State
-	sL = scheduler_newtask(L);
+	sL = scheduler_newtask(L, LIB_ALL);
+
+	//֮󴴽 cell Ĭϵڴ, system cell 
+	lua_getfield(L,1, "memory_limit");
+	hive_alloc_setdefault(luaL_optinteger(L, -1, 0));
+	lua_pop(L,1);
+
+	//launch ʱĬϼصı׼ libs = { "string", "os", ... }, ʱȫ
+	lua_getfield(L,1, "libs");
+	__default_libs = scheduler_libs(L, lua_gettop(L));
+	lua_pop(L,1);
+
+	//Ԥȴ lua_State , 0 ʾʹ
+	lua_getfield(L,1, "pool");
+	__pool.size = luaL_optinteger(L, -1, 0);
+	lua_pop(L,1);
+	if (__pool.size > 0) {
+		__pool.L = lua_newuserdata(L, __pool.size * sizeof(lua_State *));
+		pthread_mutex_init(&__pool.lock, NULL);
+		pthread_cond_init(&__pool.cond, NULL);
+	}
 
 	//cell_system_lib ,עһЩ
 	luaL_requiref(sL, "cell.system", cell_system_lib, 0);
@@ -4,7 +4,8 @@
 #include "lua.h"
 
 int scheduler_start(lua_State *L);
-lua_State * scheduler_newtask(lua_State *L);
+lua_State * scheduler_newtask(lua_State *L, int libs);
+int scheduler_libs(lua_State *L, int index);
 void scheduler_deletetask(lua_State *L);
 void scheduler_starttask(lua_State *L);
 
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <stdbool.h>
 
 #include "lua.h"
 #include "lauxlib.h"
@@ -693,4 +694,178 @@ data_unpack(lua_State *L) {
 	return lua_gettop(L) - 2;
 }
 
+// sz ֽ,  false ʾݲ
+static bool
+rb_skip(struct read_block *rb, int sz) {
+	char tmp[BLOCK_SIZE];
+	while (sz > 0) {
+		int n = sz < BLOCK_SIZE ? sz : BLOCK_SIZE;
+		if (rb_read(rb, tmp, n) == NULL) {
+			return false;
+		}
+		sz -= n;
+	}
+	return true;
+}
+
+static bool _free_one(struct read_block *rb, int depth);
+
+//һֵ,ͷе cell , Ҫ lua_State
+static bool
+_free_value(struct read_block *rb, int type, int cookie, int depth) {
+	switch(type) {
+	case TYPE_NIL:
+	case TYPE_BOOLEAN:
+		return true;
+	case TYPE_NUMBER:
+		return rb_skip(rb, cookie);
+	case TYPE_USERDATA:
+		return rb_skip(rb, sizeof(void *));
+	case TYPE_CELL: {
+		struct cell * c = NULL;
+		struct cell ** pc = rb_read(rb, &c, sizeof(c));
+		if (pc == NULL) {
+			return false;
+		}
+		cell_release(*pc);
+		return true;
+	}
+	case TYPE_SHORT_STRING:
+		return rb_skip(rb, cookie);
+	case TYPE_LONG_STRING: {
+		uint32_t len = 0;
+		if (cookie == 2) {
+			uint16_t *plen = rb_read(rb, &len, 2);
+			if (plen == NULL) {
+				return false;
+			}
+			return rb_skip(rb, *plen);
+		} else {
+			uint32_t *plen = rb_read(rb, &len, 4);
+			if (plen == NULL) {
+				return false;
+			}
+			return rb_skip(rb, *plen);
+		}
+	}
+	case TYPE_TABLE: {
+		if (depth > MAX_DEPTH) {
+			return false;
+		}
+		int array_size = cookie;
+		if (array_size == MAX_COOKIE-1) {
+			uint8_t type = 0;
+			uint8_t *t = rb_read(rb, &type, 1);
+			if (t == NULL || (*t & 7) != TYPE_NUMBER) {
+				return false;
+			}
+			int c = *t >> 3;
+			if (c == 0) {
+				array_size = 0;
+			} else if (c == 1 || c == 2 || c == 4) {
+				uint32_t n = 0;
+				void *pn = rb_read(rb, &n, c);
+				if (pn == NULL) {
+					return false;
+				}
+				array_size = c == 1 ? *(uint8_t *)pn : c == 2 ? *(uint16_t *)pn : *(int *)pn;
+			} else {
+				return false;
+			}
+		}
+		int i;
+		for (i=0;i<array_size;i++) {
+			if (!_free_one(rb, depth+1)) {
+				return false;
+			}
+		}
+		for (;;) {
+			uint8_t type = 0;
+			uint8_t *t = rb_read(rb, &type, 1);
+			if (t == NULL) {
+				return false;
+			}
+			if ((*t & 7) == TYPE_NIL) {
+				return true;
+			}
+			if (!_free_value(rb, *t & 7, *t >> 3, depth+1) || !_free_one(rb, depth+1)) {
+				return false;
+			}
+		}
+	}
+	default:
+		return false;
+	}
+}
 
+static bool
+_free_one(struct read_block *rb, int depth) {
+	uint8_t type = 0;
+	uint8_t *t = rb_read(rb, &type, 1);
+	if (t == NULL) {
+		return false;
+	}
+	return _free_value(rb, *t & 7, *t >> 3, depth);
+}
+
+// lua һϢ,ͷе cell 
+void
+data_free(void *msg) {
+	if (msg == NULL) {
+		return;
+	}
+	struct read_block rb;
+	rb_init(&rb, msg);
+	while (rb.len > 0) {
+		if (!_free_one(&rb, 0)) {
+			break;
+		}
+	}
+	rb_close(&rb);
+}
+
+//ȡϢеĵһֵ,ַ true
+bool
+data_peeknumber(void *msg, double *v) {
+	struct block * blk = msg;
+	if (blk == NULL) {
+		return false;
+	}
+	int len;
+	memcpy(&len, blk->buffer, sizeof(len));
+	const uint8_t * ptr = (const uint8_t *)blk->buffer + sizeof(len);
+	len -= sizeof(len);
+	if (len < 1 || (*ptr & 7) != TYPE_NUMBER) {
+		return false;
+	}
+	int cookie = *ptr >> 3;
+	++ptr;
+	if (len - 1 < cookie) {
+		return false;
+	}
+	switch (cookie) {
+	case 0:
+		*v = 0;
+		return true;
+	case 1:
+		*v = *ptr;
+		return true;
+	case 2: {
+		uint16_t n;
+		memcpy(&n, ptr, 2);
+		*v = n;
+		return true;
+	}
+	case 4: {
+		int n;
+		memcpy(&n, ptr, 4);
+		*v = n;
+		return true;
+	}
+	case 8:
+		memcpy(v, ptr, 8);
+		return true;
+	default:
+		return false;
+	}
+}
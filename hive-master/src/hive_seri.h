@@ -1,7 +1,11 @@
 #ifndef hive_seri_h
 #define hive_seri_h
 
+#include <stdbool.h>
+
 int data_pack(lua_State *L);
 int data_unpack(lua_State *L);
+void data_free(void *msg);
+bool data_peeknumber(void *msg, double *v);
 
 #endif
@@ -1,20 +1,98 @@
+#ifdef __linux__
+//recvmmsg sendmmsg
+#define _GNU_SOURCE
+#endif
+
 #include "hive_socket_lib.h"
+#include "hive_cell.h"
 #include "socket_poll.h"
 
 #include "lua.h"
 #include "lauxlib.h"
 
+#include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
-
-#define MAX_ID 0x7fffffff
+#include <limits.h>
+#include <sys/time.h>
+#if !USE_SELECT
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#endif
+#endif
+
+//Ӧòidĵ SLOT_BITS λ socket  slab е,λűظʹõĴ
+#define SLOT_BITS 21
+#define MAX_SOCKET (1 << SLOT_BITS)
+#define MAX_GEN (0x7fffffff >> SLOT_BITS)
+#define SLOT_INDEX(id) ((id) & (MAX_SOCKET - 1))
+// k  slab  DEFAULT_SOCKET << k  socket,ʱֻµһ,е socket ַ
 #define DEFAULT_SOCKET 128
+#define MAX_SLAB 14
 #define READ_BUFFER 4000
 #define MAX_EVENT 32
-#define BACKLOG 32
+//listen Ĭϵ backlog, listen ѡ޸
+#define BACKLOG 1024
+//readline Ĭϵг
+#define MAX_LINE 0x10000
+//readpacket Ĭϵ
+#define MAX_PACKET 0x1000000
+//ܼסλõķָ󳤶
+#define MAX_SEP 16
+//һ recvmmsg/sendmmsg ദ udp ݱ
+#define UDP_BATCH 16
+#define MAX_UDP_PACKAGE 65535
+
+//СڸóȵĴݻᱻϲͬһ
+#define SMALL_WRITE 512
+//ϲĴС
+#define MERGE_BUFFER 4096
+//sendfile һ෢͵ֽ, linux ƽ̨ pread ĻС
+#define FILE_CHUNK 0x10000
+//͵ܵ,δ֪
+#define FILE_UNTIL_EOF ((size_t)-1)
+//ȴܵʱ,ܵ poll ʱ ud  socket ĵַ 1, λ
+#define PIPE_TAG(s) ((void *)((char *)(s) + 1))
+#define IS_PIPE_TAG(ud) (((uintptr_t)(ud) & 1) != 0)
+#define PIPE_SOCKET(ud) ((struct socket *)((char *)(ud) - 1))
+
+//ʱʱֵĲ,һ 0.01 ( cell.timeout ĵδͬ)
+#define WHEEL_SIZE 4096
+//ʱ / ʱִ
+#define TIMER_OFF -1
+#define TIMER_EXPIRING -2
+#define NO_DEADLINE UINT64_MAX
+
+// write_buffer ڵ󻺴
+#define WRITE_BUFFER_CACHE 1024
+
+//дĬϸˮλ͵ˮλ
+//ˮλ csocket.write ֪ͨдߵȴ,ˮλʱ poll  {id, -1}
+#define DEFAULT_HIGH_WATER 0x1000000
+#define DEFAULT_LOW_WATER 0x400000
+
+//: سˮλʱͣ߾ܾ,ȫˮλ²Żָ
+#define ADMISSION_OFF 0
+#define ADMISSION_PAUSE 1
+#define ADMISSION_SHED 2
+//ȡڴļ,λ 0.01 
+#define MEMORY_SAMPLE 10
+
+//һ writev ෢͵Ľڵ
+#if defined(IOV_MAX)
+#define MAX_IOV IOV_MAX
+#elif defined(UIO_MAXIOV)
+#define MAX_IOV UIO_MAXIOV
+#else
+#define MAX_IOV 16
+#endif
 
 //ʾΪʹ
 #define STATUS_INVALID 0
@@ -37,20 +115,68 @@ struct write_buffer {
 
 	
 	void *buffer;
+
+	//ϲΪ 0 ʾ buffer  lsend ݣ׷
+	size_t cap;
+
+	//sendfile ڵ: ļ(ɽڵ,-1 ʾͨݽڵ),ļƫ,Ƿǹܵ
+	//sz Ϊʣֽ,ݲû̬ڴ
+	int file;
+	int pipe;
+	off_t offset;
 };
 
 //ķװ
 struct socket {
+	int lock;		//cellֱдʱҪ
 	int fd;			//socket
 	int id;			//ӦòӦidţȷظ
 
 	short status;	//״̬  ,Ƿʹã
+	int next_free;	//һ socket , -1 ʾβ
 	
 	short listen;	//ǷǼ׽
+	short udp;		//Ƿudp׽
+	short blocked;	//д˸ˮλ,ȴˮλʱ֪ͨ
+	short nodelay;	//׽ֽյǷ TCP_NODELAY
+	short paused;	//׽Ϊش poll Ƴ
+	short pipe_wait;	//дͷĹܵû,עǹܵɶ socket д
 	struct write_buffer * head;
 	struct write_buffer * tail;
+	size_t wb_size;		//деֽ
+	size_t high_water;	//Ϊ 0 ʾ
+	size_t low_water;
+
+	//ʱ,λ 0.01 ,Ϊ 0 ʾ
+	//idle: շû, read: ûյ, write: дݵûз
+	int idle_timeout;
+	int read_timeout;
+	int write_timeout;
+	uint64_t last_read;		//һյݵʱ
+	uint64_t last_write;	//һηݵʱ,дɿձΪǿʱҲ
+	//ʱе˫, socket 
+	int timer_slot;			//ڵĲ, TIMER_OFF TIMER_EXPIRING
+	int timer_prev;
+	int timer_next;
 };
  
+//Ƶֵͳ,ˮλΪ 0 ʾһ
+struct admission {
+	int mode;
+	size_t pending_high;	//cellеϢ
+	size_t pending_low;
+	size_t runnable_high;	//Ϣcell
+	size_t runnable_low;
+	size_t memory_high;		//̳פڴ,ֽ
+	size_t memory_low;
+	size_t memory;			//һζȡĽڴ
+	uint64_t memory_time;	//һζȡڴʱ
+	bool overload;
+	uint64_t overloads;		//صĴ
+	uint64_t accepted;		//յ
+	uint64_t shed;			//ʱܾ
+};
+
 //  socket*ָ
 struct socket_pool {
 	//epoll˵int	epoll_create()ķֵ
@@ -58,34 +184,204 @@ struct socket_pool {
 	
 	struct event ev[MAX_EVENT];		//epoll֮õĻԾ
 	
-	int id;		//ӦòӦidţȷظ,ʼʱΪ 1
-
 	int count;	 //ʵʴ洢
 	int cap;     //
 	
-	struct socket ** s;		//洢socket *ָ,洢ָڸԪ
+	struct socket * slab[MAX_SLAB];	// socket , k  DEFAULT_SOCKET << k
+	int slab_n;
+	int free_head;			// socket (Ƚȳ),øͷŵž
+	int free_tail;
+	int lock;				//
+
+	struct write_buffer * free_wb;	//е write_buffer ڵ
+	int free_wb_n;					//нڵ
+	int wb_lock;
+
+	char * udp_buffer;	//recvmmsg Ľջ,udp׽ʱ
+
+	//ʱʱ, socket ͷ
+	int wheel[WHEEL_SIZE];
+	int expiring;			//ڴĲȡµ
+	uint64_t wheel_time;	//һҪĲ۶Ӧʱ
+	uint64_t now;			//ÿ poll ʱ
+	int timer_lock;			//ʱ,Ҫʱ s->lock ֮
+
+	struct admission admission;	//ֻ socket cell з,Ҫ
+};
+
+//udp ݱͷ,ַ
+//תcellݿɶudp_record,деudpڵҲʽĿַ
+struct udp_record {
+	int sz;			//ݳ
+	int addrsz;		//ַ
+};
+
+#define UDP_RECORD_SIZE(addrsz, sz) ((sizeof(struct udp_record) + (addrsz) + (sz) + 7) & ~7)
+
+//Ҫ͵ udp ݱ
+struct udp_datagram {
+	const struct sockaddr * addr;
+	socklen_t addrsz;
+	const char * ptr;
+	size_t sz;
 };
 
+static inline void
+spin_lock(int *lock) {
+	while (__sync_lock_test_and_set(lock,1)) {}
+}
+
+static inline void
+spin_unlock(int *lock) {
+	__sync_lock_release(lock);
+}
+
+//ҵ socket, O(1)
+static inline struct socket *
+slot_socket(struct socket_pool *p, int index) {
+	//index λڵ k : DEFAULT_SOCKET * (2^k - 1) <= index < DEFAULT_SOCKET * (2^(k+1) - 1)
+	int k = 31 - __builtin_clz(index / DEFAULT_SOCKET + 1);
+	return &p->slab[k][index - DEFAULT_SOCKET * ((1 << k) - 1)];
+}
+
+//Ϊ index  socket β,ǰҪ p->lock
+static void
+free_slot(struct socket_pool *p, struct socket *s, int index) {
+	s->next_free = -1;
+	if (p->free_tail >= 0) {
+		slot_socket(p, p->free_tail)->next_free = index;
+	} else {
+		p->free_head = index;
+	}
+	p->free_tail = index;
+}
+
+//  socket_pool  ,µһ slab ,е socket ƶ
+// false ʾѾﵽ MAX_SOCKET
+static bool
+expand_pool(struct socket_pool *p) {
+	int k = p->slab_n;
+	int n = DEFAULT_SOCKET << k;
+	if (k >= MAX_SLAB || p->cap + n > MAX_SOCKET) {
+		return false;
+	}
+	struct socket * slab = malloc(n * sizeof(struct socket));
+	memset(slab, 0, n * sizeof(struct socket));
+	int i;
+	spin_lock(&p->lock);
+	p->slab[k] = slab;
+	p->slab_n = k + 1;
+	for (i=0;i<n;i++) {
+		slab[i].fd = -1;
+		slab[i].timer_slot = TIMER_OFF;
+		// 1 ʼ,id Ϊ 0
+		slab[i].id = p->cap + i;
+		free_slot(p, &slab[i], p->cap + i);
+	}
+	// cell е lock_socket ȡ cap, slab[k] µ socket Ҫдٷ cap
+	__atomic_store_n(&p->cap, p->cap + n, __ATOMIC_RELEASE);
+	spin_unlock(&p->lock);
+	return true;
+}
+
+//ǰʱ,λ 0.01 
+static uint64_t
+gettime(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 100 + tv.tv_usec / 10000;
+}
+
+//ʱͷ
+static inline int *
+timer_head(struct socket_pool *p, int slot) {
+	return slot == TIMER_EXPIRING ? &p->expiring : &p->wheel[slot];
+}
+
+//ʱƳ,ǰҪ p->timer_lock
+static void
+timer_unlink(struct socket_pool *p, struct socket *s) {
+	if (s->timer_slot == TIMER_OFF) {
+		return;
+	}
+	if (s->timer_prev >= 0) {
+		slot_socket(p, s->timer_prev)->timer_next = s->timer_next;
+	} else {
+		*timer_head(p, s->timer_slot) = s->timer_next;
+	}
+	if (s->timer_next >= 0) {
+		slot_socket(p, s->timer_next)->timer_prev = s->timer_prev;
+	}
+	s->timer_slot = TIMER_OFF;
+}
+
+//ʱ, deadline Ϊ NO_DEADLINE ʱƳ
+//ǰҪ s->lock
+static void
+timer_add(struct socket_pool *p, struct socket *s, uint64_t deadline) {
+	spin_lock(&p->timer_lock);
+	timer_unlink(p, s);
+	if (deadline != NO_DEADLINE) {
+		if (deadline < p->wheel_time) {
+			deadline = p->wheel_time;
+		}
+		int slot = deadline % WHEEL_SIZE;
+		int index = SLOT_INDEX(s->id);
+		int head = p->wheel[slot];
+		s->timer_slot = slot;
+		s->timer_prev = -1;
+		s->timer_next = head;
+		if (head >= 0) {
+			slot_socket(p, head)->timer_prev = index;
+		}
+		p->wheel[slot] = index;
+	}
+	spin_unlock(&p->timer_lock);
+}
+
+//շݵʱĳʱʱ
+static uint64_t
+socket_deadline(struct socket *s) {
+	uint64_t deadline = NO_DEADLINE;
+	if (s->read_timeout) {
+		deadline = s->last_read + s->read_timeout;
+	}
+	if (s->idle_timeout) {
+		uint64_t last = s->last_read > s->last_write ? s->last_read : s->last_write;
+		if (last + s->idle_timeout < deadline) {
+			deadline = last + s->idle_timeout;
+		}
+	}
+	if (s->write_timeout && s->head) {
+		if (s->last_write + s->write_timeout < deadline) {
+			deadline = s->last_write + s->write_timeout;
+		}
+	}
+	return deadline;
+}
+
 //ʼ  socket_pool
 static int
 linit(lua_State *L) {
 	struct socket_pool * sp = lua_touserdata(L, lua_upvalueindex(1));
-	if (sp->s) {
+	if (sp->slab_n) {
 		return luaL_error(L, "Don't init socket twice");
 	}
 	//epoll˵ǵepoll_create
 	sp->fd = sp_create();
 	
 	sp->count = 0;
-	sp->cap = DEFAULT_SOCKET;
-	sp->id = 1;
-	sp->s = malloc(sp->cap * sizeof(struct socket *));
+	sp->cap = 0;
+	sp->free_head = -1;
+	sp->free_tail = -1;
+	expand_pool(sp);
 	int i;
-	
-	for (i=0;i<sp->cap;i++) {
-		sp->s[i] = malloc(sizeof(struct socket));
-		memset(sp->s[i],0, sizeof(struct socket));
+	for (i=0;i<WHEEL_SIZE;i++) {
+		sp->wheel[i] = -1;
 	}
+	sp->expiring = -1;
+	sp->now = gettime();
+	sp->wheel_time = sp->now;
 	return 0;
 }
 
@@ -94,117 +390,419 @@ linit(lua_State *L) {
 static inline struct socket_pool *
 get_sp(lua_State *L) {
 	struct socket_pool * pool = lua_touserdata(L, lua_upvalueindex(1));
-	if (pool->s == NULL) {
+	if (pool->slab_n == 0) {
 		luaL_error(L, "Init socket first");
 	}
 	return pool;
 }
 
+//ӿȡһ write_buffer ڵ㣬û malloc
+static struct write_buffer *
+wb_new(struct socket_pool *p) {
+	spin_lock(&p->wb_lock);
+	struct write_buffer * wb = p->free_wb;
+	if (wb) {
+		p->free_wb = wb->next;
+		--p->free_wb_n;
+		spin_unlock(&p->wb_lock);
+	} else {
+		spin_unlock(&p->wb_lock);
+		wb = malloc(sizeof(*wb));
+	}
+	wb->next = NULL;
+	wb->buffer = NULL;
+	wb->cap = 0;
+	wb->file = -1;
+	return wb;
+}
+
+//ͷŽڵеݣڵŻؿ
+static void
+wb_delete(struct socket_pool *p, struct write_buffer *wb) {
+	free(wb->buffer);
+	if (wb->file >= 0) {
+		close(wb->file);
+	}
+	spin_lock(&p->wb_lock);
+	if (p->free_wb_n >= WRITE_BUFFER_CACHE) {
+		spin_unlock(&p->wb_lock);
+		free(wb);
+		return;
+	}
+	wb->next = p->free_wb;
+	p->free_wb = wb;
+	++p->free_wb_n;
+	spin_unlock(&p->wb_lock);
+}
+
+//ͷӦд
+static void
+wb_clear(struct socket_pool *p, struct socket *s) {
+	struct write_buffer *wb = s->head;
+	while (wb) {
+		struct write_buffer *tmp = wb;
+		wb = wb->next;
+		wb_delete(p, tmp);
+	}
+	s->head = s->tail = NULL;
+	s->wb_size = 0;
+}
+
 //˳
 static int
 lexit(lua_State *L) {
 	struct socket_pool * pool = lua_touserdata(L, 1);
-	int i;
-	if (pool->s) {
-		for (i=0;i<pool->cap;i++) {
+	int i,j;
+	for (i=0;i<pool->slab_n;i++) {
+		struct socket * slab = pool->slab[i];
+		for (j=0;j<(DEFAULT_SOCKET << i);j++) {
 			//رЧ
-			if (pool->s[i]->status != STATUS_INVALID && pool->s[i]->fd >=0) {
+			if (slab[j].status != STATUS_INVALID && slab[j].fd >=0) {
 				//õclose()
-				closesocket(pool->s[i]->fd);
+				closesocket(slab[j].fd);
 			}
-			free(pool->s[i]);
+			wb_clear(pool, &slab[j]);
 		}
-		free(pool->s);
-		pool->s = NULL;
+		free(slab);
+		pool->slab[i] = NULL;
+	}
+	pool->slab_n = 0;
+	while (pool->free_wb) {
+		struct write_buffer * wb = pool->free_wb;
+		pool->free_wb = wb->next;
+		free(wb);
 	}
+	pool->free_wb_n = 0;
+	free(pool->udp_buffer);
+	pool->udp_buffer = NULL;
 	pool->cap = 0;
 	pool->count = 0;
+	pool->free_head = pool->free_tail = -1;
 	if (!sp_invalid(pool->fd)) {
 					//close()
 		pool->fd = sp_release(pool->fd);
 	}
-	pool->id = 1;
 
 	return 0;
 }
 
-//  socket_pool   
-static void
-expand_pool(struct socket_pool *p) {
-	struct socket ** s = malloc(p->cap * 2 * sizeof(struct socket *));
-	memset(s, 0, p->cap * 2 * sizeof(struct socket *));
-	int i;
-
-	//ԭ
-	for (i=0;i<p->cap;i++) {
-		int nid = p->s[i]->id % (p->cap *2);
-		assert(s[nid] == NULL);
-		s[nid] = p->s[i];
+//ӦòidҵӦsocket,idЧʱNULL
+static struct socket *
+lock_socket(struct socket_pool *p, int id) {
+	int index = SLOT_INDEX(id);
+	// expand_pool е release , µ cap ʱҲܶӦ slab
+	if ((id >> SLOT_BITS) <= 0 || index >= __atomic_load_n(&p->cap, __ATOMIC_ACQUIRE)) {
+		return NULL;
 	}
-	for (i=0;i<p->cap * 2;i++) {
-		if (s[i] == NULL) {
-			s[i] = malloc(sizeof(struct socket));
-			memset(s[i],0,sizeof(struct socket));
-		}
+	struct socket * s = slot_socket(p, index);
+	spin_lock(&s->lock);
+	if (s->id != id) {
+		spin_unlock(&s->lock);
+		return NULL;
 	}
-	free(p->s);
-	p->s = s;
-	p->cap *=2;
+	return s;
 }
 
-//socket_pool sock
+//socket_pool sock, nonblocking Ϊ true ʾ sock ѾǷ
+//ӿͷȡ socket, id Ĵ 1
 static int
-new_socket(struct socket_pool *p, int sock) {
-	int i;
-	//
-	if (p->count >= p->cap) {
-		expand_pool(p);
+new_socket(struct socket_pool *p, int sock, bool nonblocking) {
+	spin_lock(&p->lock);
+	if (p->free_head < 0) {
+		spin_unlock(&p->lock);
+		//
+		if (!expand_pool(p)) {
+			goto _error;
+		}
+		spin_lock(&p->lock);
+	}
+	int index = p->free_head;
+	struct socket * s = slot_socket(p, index);
+	p->free_head = s->next_free;
+	if (p->free_head < 0) {
+		p->free_tail = -1;
+	}
+	spin_unlock(&p->lock);
+
+	assert(s->status == STATUS_INVALID);
+	//ӵepoll
+	if (sp_add(p->fd, sock, s)) {
+		spin_lock(&p->lock);
+		free_slot(p, s, index);
+		spin_unlock(&p->lock);
+		goto _error;
+	}
+
+	int gen = (s->id >> SLOT_BITS) + 1;
+	if (gen > MAX_GEN) {
+		gen = 1;
 	}
 
+	spin_lock(&s->lock);
+	//޸״̬
+	s->status = STATUS_SUSPEND;
 	
-	for (i=0;i<p->cap;i++) {
-		int id = p->id + i;
-		int n = id % p->cap;
-		struct socket * s = p->s[n];
-		
-		if (s->status == STATUS_INVALID) {
-			
-			//ӵepoll
-			if (sp_add(p->fd, sock, s)) {
-				goto _error;
-			}
+	s->listen = 0; //ǷǼ׽
+	s->udp = 0;
+	s->nodelay = 0;
+	s->paused = 0;
+	s->blocked = 0;
+	s->wb_size = 0;
+	s->high_water = DEFAULT_HIGH_WATER;
+	s->low_water = DEFAULT_LOW_WATER;
+	//ܻʱ,ʱᱻƳ
+	s->idle_timeout = 0;
+	s->read_timeout = 0;
+	s->write_timeout = 0;
+	s->last_read = s->last_write = p->now;
+
+	//
+	if (!nonblocking) {
+		sp_nonblocking(sock);
+	}
 
-			//޸״̬
-			s->status = STATUS_SUSPEND;
-			
-			s->listen = 0; //ǷǼ׽
+	s->fd = sock;
+	s->id = (gen << SLOT_BITS) | index;
+	p->count++;
+	assert(s->head == NULL && s->tail == NULL);
+	spin_unlock(&s->lock);
 
-			//
-			sp_nonblocking(sock);
-			
-			int keepalive = 1; 
-			setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (void *)&keepalive , sizeof(keepalive));
+	//Ӧòάid
+	return s->id;
+_error:
+	closesocket(sock);
+	return -1;
+}
 
-			s->fd = sock;
-			s->id = id;
-			p->count++;
-			p->id = id + 1;
-			
-			if (p->id > MAX_ID) {
-				p->id = 1;
-			}
-			assert(s->head == NULL && s->tail == NULL);
+//󶨵ַ,صַ
+//֧ "port" "ip:port" "[ipv6]:port" "unix:/path",linux  "unix:@name" Ϊռ
+static socklen_t
+parse_address(lua_State *L, const char * name, size_t len, struct sockaddr_storage *addr) {
+	memset(addr, 0, sizeof(*addr));
+#if !USE_SELECT
+	if (len > 5 && memcmp(name, "unix:", 5) == 0) {
+		struct sockaddr_un * un = (struct sockaddr_un *)addr;
+		const char * path = name + 5;
+		size_t plen = len - 5;
+		if (plen >= sizeof(un->sun_path)) {
+			luaL_error(L, "Invalid address %s", name);
+		}
+		un->sun_family = AF_UNIX;
+		memcpy(un->sun_path, path, plen);
+#ifdef __linux__
+		if (path[0] == '@') {
+			//ռ,sun_path  '\0' ͷ,Ȳβ '\0'
+			un->sun_path[0] = '\0';
+			return offsetof(struct sockaddr_un, sun_path) + plen;
+		}
+#endif
+		return sizeof(*un);
+	}
+#endif
+	int port = 0;
+	char binding[len+1];
+	memcpy(binding, name, len+1);
+	char * host = NULL;
+	char * portstr = NULL;
+	if (binding[0] == '[') {
+		//ipv6
+		char * end = strchr(binding, ']');
+		if (end == NULL || end[1] != ':') {
+			luaL_error(L, "Invalid address %s", name);
+		}
+		end[0] = '\0';
+		host = binding + 1;
+		portstr = end + 2;
+	} else {
+		portstr = strchr(binding,':');
+		if (portstr) {
+			portstr[0] = '\0';
+			host = binding;
+			++portstr;
+		} else {
+			portstr = binding;
+		}
+	}
+	//˿
+	port = strtol(portstr, NULL, 10);
+	if (port <= 0) {
+		luaL_error(L, "Invalid address %s", name);
+	}
 
-			//Ӧòάid
-			return id;
+	if (binding[0] == '[') {
+		struct sockaddr_in6 * in6 = (struct sockaddr_in6 *)addr;
+		in6->sin6_family = AF_INET6;
+		in6->sin6_port = htons(port);
+		if (inet_pton(AF_INET6, host, &in6->sin6_addr) != 1) {
+			luaL_error(L, "Invalid address %s", name);
 		}
+		return sizeof(*in6);
+	}
+
+	struct sockaddr_in * in = (struct sockaddr_in *)addr;
+	in->sin_family = AF_INET;
+	in->sin_port = htons(port);
+	in->sin_addr.s_addr = INADDR_ANY;
+	if (host && inet_pton(AF_INET, host, &in->sin_addr) != 1) {
+		luaL_error(L, "Invalid address %s", name);
+	}
+	return sizeof(*in);
+}
+
+//ַתַͶ˿ѹջ,ѹջĸ
+//unix ׽ֵĵַΪ "unix:path",˿Ϊ 0
+static int
+push_address(lua_State *L, const struct sockaddr *sa, socklen_t len) {
+	char tmp[INET6_ADDRSTRLEN];
+	switch (sa->sa_family) {
+	case AF_INET: {
+		const struct sockaddr_in * in = (const struct sockaddr_in *)sa;
+		lua_pushstring(L, inet_ntop(AF_INET, &in->sin_addr, tmp, sizeof(tmp)));
+		lua_pushinteger(L, ntohs(in->sin_port));
+		return 2;
+	}
+	case AF_INET6: {
+		const struct sockaddr_in6 * in6 = (const struct sockaddr_in6 *)sa;
+		lua_pushstring(L, inet_ntop(AF_INET6, &in6->sin6_addr, tmp, sizeof(tmp)));
+		lua_pushinteger(L, ntohs(in6->sin6_port));
+		return 2;
+	}
+#if !USE_SELECT
+	case AF_UNIX: {
+		const struct sockaddr_un * un = (const struct sockaddr_un *)sa;
+		size_t off = offsetof(struct sockaddr_un, sun_path);
+		size_t plen = len > off ? len - off : 0;
+		luaL_Buffer b;
+		luaL_buffinit(L, &b);
+		luaL_addstring(&b, "unix:");
+		if (plen > 0 && un->sun_path[0] == '\0') {
+			//ռ
+			luaL_addchar(&b, '@');
+			luaL_addlstring(&b, un->sun_path + 1, plen - 1);
+		} else {
+			luaL_addlstring(&b, un->sun_path, strnlen(un->sun_path, plen));
+		}
+		luaL_pushresult(&b);
+		lua_pushinteger(L, 0);
+		return 2;
+	}
+#endif
+	default:
+		lua_pushnil(L);
+		lua_pushinteger(L, 0);
+		return 2;
+	}
+}
+
+//ѡõ setsockopt  level  optname
+// 0 ɹ, -1 δ֪ѡ, 1 ǰƽ̨֧
+//fastopen Լ׽ TCP_FASTOPEN Ķг,׽ TCP_FASTOPEN_CONNECT
+static int
+option_name(const char *name, bool listen, int *level, int *opt) {
+	*level = IPPROTO_TCP;
+	if (strcmp(name, "nodelay") == 0) {
+		*opt = TCP_NODELAY;
+	} else if (strcmp(name, "keepalive") == 0) {
+		*level = SOL_SOCKET;
+		*opt = SO_KEEPALIVE;
+	} else if (strcmp(name, "rcvbuf") == 0) {
+		*level = SOL_SOCKET;
+		*opt = SO_RCVBUF;
+	} else if (strcmp(name, "sndbuf") == 0) {
+		*level = SOL_SOCKET;
+		*opt = SO_SNDBUF;
+	} else if (strcmp(name, "cork") == 0) {
+#if defined(TCP_CORK)
+		*opt = TCP_CORK;
+#elif defined(TCP_NOPUSH)
+		*opt = TCP_NOPUSH;
+#else
+		return 1;
+#endif
+	} else if (strcmp(name, "defer_accept") == 0) {
+#ifdef TCP_DEFER_ACCEPT
+		*opt = TCP_DEFER_ACCEPT;
+#else
+		return 1;
+#endif
+	} else if (strcmp(name, "fastopen") == 0) {
+		if (listen) {
+#ifdef TCP_FASTOPEN
+			*opt = TCP_FASTOPEN;
+#else
+			return 1;
+#endif
+		} else {
+#ifdef TCP_FASTOPEN_CONNECT
+			*opt = TCP_FASTOPEN_CONNECT;
+#else
+			return 1;
+#endif
+		}
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+//ѡֵ,boolean ת 0  1
+static int
+option_value(lua_State *L, int idx) {
+	if (lua_isboolean(L, idx)) {
+		return lua_toboolean(L, idx);
+	}
+	return luaL_checkinteger(L, idx);
+}
+
+//ѡ {nodelay=true, rcvbuf=65536, ...},ڴ֮ǰ,֮ set_options 
+static void
+check_options(lua_State *L, int idx) {
+	if (lua_isnoneornil(L, idx)) {
+		return;
+	}
+	luaL_checktype(L, idx, LUA_TTABLE);
+	lua_pushnil(L);
+	while (lua_next(L, idx) != 0) {
+		if (lua_type(L, -2) != LUA_TSTRING) {
+			luaL_error(L, "Invalid socket option");
+		}
+		const char * name = lua_tostring(L, -2);
+		int level, opt;
+		if (strcmp(name, "backlog") != 0 && option_name(name, true, &level, &opt) < 0) {
+			luaL_error(L, "Unknown socket option %s", name);
+		}
+		option_value(L, -1);
+		lua_pop(L, 1);
+	}
+}
+
+//ѡеѡ, backlog  listen ,ǰƽֵ̨֧ѡ
+static void
+set_options(lua_State *L, int idx, int fd, bool listen) {
+	if (lua_isnoneornil(L, idx)) {
+		return;
+	}
+	lua_pushnil(L);
+	while (lua_next(L, idx) != 0) {
+		const char * name = lua_tostring(L, -2);
+		int level, opt;
+		if (strcmp(name, "backlog") != 0 && option_name(name, listen, &level, &opt) == 0) {
+			int v = option_value(L, -1);
+			setsockopt(fd, level, opt, (void *)&v, sizeof(v));
+		}
+		lua_pop(L, 1);
 	}
-_error:
-	closesocket(sock);
-	return -1;
+}
+
+//׽ĬϿ SO_KEEPALIVE
+static void
+set_keepalive(int fd) {
+	int keepalive = 1; 
+	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, (void *)&keepalive , sizeof(keepalive));
 }
 
 //socket,connect,뵽socket_pool, socketӦӦò
+//csocket.connect(host, port, opts) opts  set_options
 static int
 lconnect(lua_State *L) {
 	int status;
@@ -217,10 +815,40 @@ lconnect(lua_State *L) {
 	struct socket_pool * pool = get_sp(L);
 
 	//ȡ
-	const char * host = luaL_checkstring(L,1);
+	size_t hlen = 0;
+	const char * host = luaL_checklstring(L,1,&hlen);
+
+#if !USE_SELECT
+	//unix ׽  "unix:/path"  "unix:@name"
+	if (hlen > 5 && memcmp(host, "unix:", 5) == 0) {
+		struct sockaddr_storage addr;
+		socklen_t addrsz = parse_address(L, host, hlen, &addr);
+		check_options(L, 3);
+		int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (sock < 0) {
+			return 0;
+		}
+		set_options(L, 3, sock, false);
+		if (connect(sock, (struct sockaddr *)&addr, addrsz) != 0) {
+			close(sock);
+			return 0;
+		}
+		lua_pushinteger(L, new_socket(pool, sock, false));
+		return 1;
+	}
+#endif
 
 	//ȡ˿
 	const char * port = luaL_checkstring(L,2);
+	check_options(L, 3);
+
+	//"[ipv6]" ȥ
+	char tmp[hlen+1];
+	if (hlen > 2 && host[0] == '[' && host[hlen-1] == ']') {
+		memcpy(tmp, host+1, hlen-2);
+		tmp[hlen-2] = '\0';
+		host = tmp;
+	}
 
 	memset( &ai_hints, 0, sizeof( ai_hints ) );
 	
@@ -242,6 +870,9 @@ lconnect(lua_State *L) {
 		if ( sock < 0 ) {
 			continue;
 		}
+		set_keepalive(sock);
+		//СѡҪ֮ǰ
+		set_options(L, 3, sock, false);
 		//
 		status = connect( sock,	ai_ptr->ai_addr, ai_ptr->ai_addrlen	);
 		if ( status	!= 0 ) {
@@ -259,30 +890,56 @@ lconnect(lua_State *L) {
 	}
 
 	//뵽poolй뵽epoll
-	int fd = new_socket(pool, sock);
+	int fd = new_socket(pool, sock, false);
 
 	//ضӦӦòid
 	lua_pushinteger(L,fd);
 	return 1;
 }
 
+//ܵûʱ splice Ҳ EAGAIN,  socket Ȼд, עдᱻͣĻ
+//ʱΪעܵɶ, ܵ(д˹ر)ٹע socket д
+//ǰҪ s->lock
+static void
+pipe_watch(struct socket_pool *p, struct socket *s, struct write_buffer *wb) {
+#ifdef __linux__
+	int n = 0;
+	if (ioctl(wb->file, FIONREAD, &n) == 0 && n > 0) {
+		//ܵ,  socket ķͻ
+		return;
+	}
+	if (!s->pipe_wait) {
+		if (sp_add(p->fd, wb->file, PIPE_TAG(s))) {
+			return;
+		}
+		s->pipe_wait = 1;
+	}
+	sp_write(p->fd, s->fd, s, false);
+#endif
+}
+
+//ٹעܵ, дͷĹܵڵ㱻ɾ֮ǰҪ
+static void
+pipe_unwatch(struct socket_pool *p, struct socket *s) {
+	if (s->pipe_wait) {
+		s->pipe_wait = 0;
+		sp_del(p->fd, s->head->file);
+	}
+}
 
 //socket_pool *pƳsocket,ҹرնӦsocket
 
 //ڿͻϿӣread0ʱ
+//ǰҪ s->lock
 static void
 force_close(struct socket *s, struct socket_pool *p) {
 
-	struct write_buffer *wb = s->head;
+	//ܵ wb_clear йر,ȴ poll Ƴ
+	pipe_unwatch(p, s);
+
 	//дĻ
-	while (wb) {
-		struct write_buffer *tmp = wb;
-		wb = wb->next;
-		free(tmp->buffer);
-		free(tmp);
-	}
-	s->head = s->tail = NULL;
-	
+	wb_clear(p, s);
+
 	s->status = STATUS_INVALID; //״̬Ϊδʹ
 
 	if (s->fd >=0 ) {
@@ -294,7 +951,18 @@ force_close(struct socket *s, struct socket_pool *p) {
 
 		s->fd = -1;
 	}
+
+	//ʱƳ,λ·ܻھɵ
+	spin_lock(&p->timer_lock);
+	timer_unlink(p, s);
+	spin_unlock(&p->timer_lock);
+
 	--p->count;
+
+	//Żؿ, s->id ֲ,ֱ·ǰɵ id Ȼҵ socket
+	spin_lock(&p->lock);
+	free_slot(p, s, SLOT_INDEX(s->id));
+	spin_unlock(&p->lock);
 }
 
 
@@ -308,12 +976,13 @@ lclose(lua_State *L) {
 	int id = luaL_checkinteger(L,1);
 
 	//öӦλ
-	struct socket * s = p->s[id % p->cap];
+	struct socket * s = lock_socket(p, id);
 	
-	if (id != s->id) {
+	if (s == NULL) {
 		return luaL_error(L, "Close invalid socket %d", id);
 	}
 	if (s->status == STATUS_INVALID) {
+		spin_unlock(&s->lock);
 		return 0;
 	}
 	
@@ -324,6 +993,7 @@ lclose(lua_State *L) {
 		//״̬
 		s->status = STATUS_HALFCLOSE;
 	}
+	spin_unlock(&s->lock);
 	return 0;
 }
 
@@ -433,11 +1103,17 @@ push_result(lua_State *L, int idx, struct socket *s, struct socket_pool *p) {
 		if (r == 0) {
 
 			//ͻӦstruct socketsocket_poolƳرնӦ
+			spin_lock(&s->lock);
 			force_close(s,p);
+			spin_unlock(&s->lock);
 			free(buffer);
 			buffer = NULL;
 		}
 
+		if (r > 0) {
+			s->last_read = p->now;
+		}
+
 		//ر״̬Ͳٽ
 		if (s->status == STATUS_HALFCLOSE)
 		{
@@ -457,7 +1133,7 @@ push_result(lua_State *L, int idx, struct socket *s, struct socket_pool *p) {
 
 			//t[1]=s->id
 
-			 {0={},idx={1=s->sid}}  {} {1=s->sid}
+			// {0={},idx={1=s->sid}}  {} {1=s->sid}
 			lua_rawseti(L, -2, 1);
 
 			//rǶݳ
@@ -483,27 +1159,137 @@ push_result(lua_State *L, int idx, struct socket *s, struct socket_pool *p) {
 	}
 }
 
+//̵ĳפڴ,ֻ֧ linux, ƽ̨ 0
+static size_t
+process_memory(void) {
+#ifdef __linux__
+	char tmp[64];
+	int fd = open("/proc/self/statm", O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	int n = read(fd, tmp, sizeof(tmp) - 1);
+	close(fd);
+	if (n <= 0) {
+		return 0;
+	}
+	tmp[n] = '\0';
+	//ڶǳפڴҳ
+	unsigned long size = 0, resident = 0;
+	if (sscanf(tmp, "%lu %lu", &size, &resident) != 2) {
+		return 0;
+	}
+	return (size_t)resident * sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+//ͣ߻ָм׽ֵĿɶ¼,δں˵ backlog 
+static void
+admission_pause(struct socket_pool *p, bool pause) {
+	int i;
+	for (i=0;i<p->cap;i++) {
+		struct socket *s = slot_socket(p, i);
+		if (s->status == STATUS_INVALID || !s->listen || s->paused == pause) {
+			continue;
+		}
+		if (pause) {
+			sp_del(p->fd, s->fd);
+		} else if (sp_add(p->fd, s->fd, s)) {
+			continue;
+		}
+		s->paused = pause;
+	}
+}
+
+//ÿ poll ʱ鸺,һˮλ,ȫˮλ²Żָ
+static void
+admission_check(struct socket_pool *p) {
+	struct admission *a = &p->admission;
+	if (a->mode == ADMISSION_OFF) {
+		return;
+	}
+	int pending, runnable;
+	cell_load(&pending, &runnable);
+	if (a->memory_high && p->now >= a->memory_time) {
+		a->memory = process_memory();
+		a->memory_time = p->now + MEMORY_SAMPLE;
+	}
+	if (!a->overload) {
+		if ((a->pending_high && (size_t)pending >= a->pending_high) ||
+			(a->runnable_high && (size_t)runnable >= a->runnable_high) ||
+			(a->memory_high && a->memory >= a->memory_high)) {
+			a->overload = true;
+			++a->overloads;
+			if (a->mode == ADMISSION_PAUSE) {
+				admission_pause(p, true);
+			}
+		}
+	} else if ((a->pending_high == 0 || (size_t)pending <= a->pending_low) &&
+		(a->runnable_high == 0 || (size_t)runnable <= a->runnable_low) &&
+		(a->memory_high == 0 || a->memory <= a->memory_low)) {
+		a->overload = false;
+		admission_pause(p, false);
+	}
+}
+
 //ӡaccept
 //epollɶô˺
 static int
 accept_result(lua_State *L, int idx, struct socket *s, struct socket_pool *p) {
+	struct admission *a = &p->admission;
+	if (s->paused) {
+		//Ƴ֮ǰѾ¼
+		return 0;
+	}
+	if (a->overload && a->mode == ADMISSION_PAUSE) {
+		//֮Ŵļ׽
+		sp_del(p->fd, s->fd);
+		s->paused = 1;
+		return 0;
+	}
 	int ret = 0;
 	for (;;) {
-		struct sockaddr_in remote_addr;
-		socklen_t len = sizeof(struct sockaddr_in);
-
-		//accept
+		struct sockaddr_storage remote_addr;
+		socklen_t len = sizeof(remote_addr);
+
+		//accept, linux  accept4 ֱӵõ,ʡȥ fcntl
+#ifdef __linux__
+		int client_fd = accept4(s->fd , (struct sockaddr *)&remote_addr ,  &len, SOCK_NONBLOCK);
+		bool nonblocking = true;
+#else
 		int client_fd = accept(s->fd , (struct sockaddr *)&remote_addr ,  &len);
+		bool nonblocking = false;
+#endif
 
 		//ֱ˴
 		if (client_fd < 0) {
-			
+			if (errno == EINTR) {
+				continue;
+			}
 			return ret;
 		}
 
+		if (a->overload) {
+			//ʱܾ
+			closesocket(client_fd);
+			++a->shed;
+			continue;
+		}
+		++a->accepted;
+
+		if (remote_addr.ss_family != AF_UNIX) {
+			set_keepalive(client_fd);
+			if (s->nodelay) {
+				int nodelay = 1;
+				setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, (void *)&nodelay, sizeof(nodelay));
+			}
+		}
+
 		//ӵӵsock pool   pУ뵽epoll
 		//idӵӦӦòid
-		int id = new_socket(p, client_fd);
+		int id = new_socket(p, client_fd, nonblocking);
 		if (id < 0) {
 			return ret;
 		}
@@ -527,9 +1313,11 @@ accept_result(lua_State *L, int idx, struct socket *s, struct socket_pool *p) {
 		//֮  {0={},1={1=s->id,2=id}}  {} {1=s->id,2=id}
 		lua_rawseti(L, -2, 2);
 		
-		lua_pushstring(L, inet_ntoa(remote_addr.sin_addr));
+		//Զ˵ַͶ˿
+		push_address(L, (struct sockaddr *)&remote_addr, len);
+		lua_rawseti(L, -3, 4);
 
-		//֮  {0={},1={1=s->id,2=id,3="......."}}  {} {1=s->id,2=id,3="......."}
+		//֮  {0={},1={1=s->id,2=id,3=".......",4=port}}  {} {1=s->id,2=id,3=".......",4=port}
 		lua_rawseti(L, -2, 3);
 
 		// {0={},idx={1=s->id,2=id,3="......."}}  {} 
@@ -538,39 +1326,347 @@ accept_result(lua_State *L, int idx, struct socket *s, struct socket_pool *p) {
 }
 
 
-//ӦķͻȫͣҲټд¼
-static void
-sendout(struct socket_pool *p, struct socket *s) {
-	while (s->head) {
-		struct write_buffer * tmp = s->head;
-		for (;;) {
-			int sz = send(s->fd, tmp->ptr, tmp->sz,0);
-			if (sz < 0) {
-				switch(errno) {
-				case EINTR:
+//д¼  {id, sz} , sz Ϊ -1 ʾ˵ˮλ, 0 ʾͳѾر
+static int
+drain_result(lua_State *L, int idx, int id, int sz) {
+	result_n(L, idx);
+	lua_pushinteger(L, id);
+	lua_rawseti(L, -2, 1);
+	lua_pushinteger(L, sz);
+	lua_rawseti(L, -2, 2);
+	lua_pushnil(L);
+	lua_rawseti(L, -2, 3);
+	lua_pop(L,1);
+	return 1;
+}
+
+// sendfile ڵе,ط͵ֽ, 0 ʾļѾ
+//linux ļ sendfile,ܵ splice,ݲû̬;ƽ̨ pread + send
+static ssize_t
+send_file(int sock, struct write_buffer *wb) {
+	size_t n = wb->sz > FILE_CHUNK ? FILE_CHUNK : wb->sz;
+#if USE_SELECT
+	(void)n;
+	errno = EBADF;
+	return -1;
+#elif defined(__linux__)
+	if (wb->pipe) {
+		return splice(wb->file, NULL, sock, NULL, n, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	}
+	return sendfile(sock, wb->file, &wb->offset, n);
+#else
+	char tmp[FILE_CHUNK];
+	ssize_t r = pread(wb->file, tmp, n, wb->offset);
+	if (r <= 0) {
+		return r;
+	}
+	ssize_t w = send(sock, tmp, r, 0);
+	if (w > 0) {
+		wb->offset += w;
+	}
+	return w;
+#endif
+}
+
+//ӦķͻȫͣҲټд¼
+// writev һη MAX_IOV ڵ, sendfile ڵ㵥
+static void
+sendout(struct socket_pool *p, struct socket *s) {
+	struct iovec iov[MAX_IOV];
+	while (s->head) {
+		struct write_buffer * tmp = s->head;
+		if (tmp->file >= 0) {
+			ssize_t sz = send_file(s->fd, tmp);
+			if (sz < 0) {
+				switch(errno) {
+				case EINTR:
 					continue;
 				case EAGAIN:
+					if (tmp->pipe) {
+						pipe_watch(p, s, tmp);
+					}
 					return;
 				}
 				force_close(s,p);
 				return;
 			}
-			if (sz != tmp->sz) {
-				tmp->ptr += sz;
-				tmp->sz -= sz;
+			if (sz > 0) {
+				s->last_write = p->now;
+				if (tmp->sz != FILE_UNTIL_EOF) {
+					tmp->sz -= sz;
+				}
+			}
+			//ϻļѾ
+			if (sz == 0 || tmp->sz == 0) {
+				pipe_unwatch(p, s);
+				s->head = tmp->next;
+				wb_delete(p, tmp);
+			}
+			continue;
+		}
+		int n = 0;
+		size_t total = 0;
+		while (tmp && tmp->file < 0 && n < MAX_IOV) {
+			iov[n].iov_base = tmp->ptr;
+			iov[n].iov_len = tmp->sz;
+			total += tmp->sz;
+			++n;
+			tmp = tmp->next;
+		}
+		ssize_t sz;
+		for (;;) {
+			sz = writev(s->fd, iov, n);
+			if (sz < 0) {
+				switch(errno) {
+				case EINTR:
+					continue;
+				case EAGAIN:
+					return;
+				}
+				force_close(s,p);
 				return;
 			}
 			break;
 		}
-		s->head = tmp->next;
-		free(tmp->buffer);
-		free(tmp);
+		s->wb_size -= sz;
+		if (sz > 0) {
+			s->last_write = p->now;
+		}
+		//ͷѾĽڵ
+		size_t left = sz;
+		while (left > 0) {
+			tmp = s->head;
+			if (left < tmp->sz) {
+				tmp->ptr += left;
+				tmp->sz -= left;
+				return;
+			}
+			left -= tmp->sz;
+			s->head = tmp->next;
+			wb_delete(p, tmp);
+		}
+		//ں˷ͻ
+		if (sz != total) {
+			return;
+		}
 	}
 	s->tail = NULL;
 	//ٹעд¼
 	sp_write(p->fd, s->fd, s, false);
 }
  
+// udp ݱ, i ݱ buffer + i * MAX_UDP_PACKAGE
+//ؽյĸ,ûʱ -1
+static int
+udp_recvbatch(int fd, char * buffer, int sz[], struct sockaddr_storage addr[], socklen_t addrsz[]) {
+	int i;
+#ifdef __linux__
+	struct mmsghdr msg[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	memset(msg, 0, sizeof(msg));
+	for (i=0;i<UDP_BATCH;i++) {
+		iov[i].iov_base = buffer + i * MAX_UDP_PACKAGE;
+		iov[i].iov_len = MAX_UDP_PACKAGE;
+		msg[i].msg_hdr.msg_name = &addr[i];
+		msg[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	int n;
+	for (;;) {
+		n = recvmmsg(fd, msg, UDP_BATCH, 0, NULL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		break;
+	}
+	for (i=0;i<n;i++) {
+		sz[i] = msg[i].msg_len;
+		addrsz[i] = msg[i].msg_hdr.msg_namelen;
+	}
+	return n;
+#else
+	for (i=0;i<UDP_BATCH;i++) {
+		addrsz[i] = sizeof(addr[i]);
+		int r = recvfrom(fd, buffer + i * MAX_UDP_PACKAGE, MAX_UDP_PACKAGE, 0, (struct sockaddr *)&addr[i], &addrsz[i]);
+		if (r < 0) {
+			if (errno == EINTR) {
+				--i;
+				continue;
+			}
+			break;
+		}
+		sz[i] = r;
+	}
+	return i > 0 ? i : -1;
+#endif
+}
+
+// udp ݱ,طͳɹĸ,һͷʧʱ -1
+static int
+udp_sendbatch(int fd, struct udp_datagram *d, int n) {
+	int i;
+#ifdef __linux__
+	struct mmsghdr msg[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	memset(msg, 0, n * sizeof(msg[0]));
+	for (i=0;i<n;i++) {
+		iov[i].iov_base = (void *)d[i].ptr;
+		iov[i].iov_len = d[i].sz;
+		msg[i].msg_hdr.msg_name = (void *)d[i].addr;
+		msg[i].msg_hdr.msg_namelen = d[i].addrsz;
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	return sendmmsg(fd, msg, n, 0);
+#else
+	for (i=0;i<n;i++) {
+		if (sendto(fd, d[i].ptr, d[i].sz, 0, d[i].addr, d[i].addrsz) < 0) {
+			return i > 0 ? i : -1;
+		}
+	}
+	return n;
+#endif
+}
+
+//udpɶʱô˺
+//һ recvmmsg յݱһݿ,ֻһ {s->id, sz, buffer}
+//cell  csocket.udpunpack ⿪
+static int
+udp_result(lua_State *L, int idx, struct socket *s, struct socket_pool *p) {
+	int ret = 0;
+	int sz[UDP_BATCH];
+	struct sockaddr_storage addr[UDP_BATCH];
+	socklen_t addrsz[UDP_BATCH];
+	for (;;) {
+		int n = udp_recvbatch(s->fd, p->udp_buffer, sz, addr, addrsz);
+		if (n <= 0) {
+			return ret;
+		}
+		int i;
+		size_t total = 0;
+		for (i=0;i<n;i++) {
+			total += UDP_RECORD_SIZE(addrsz[i], sz[i]);
+		}
+		char * buffer = malloc(total);
+		char * ptr = buffer;
+		for (i=0;i<n;i++) {
+			struct udp_record * r = (struct udp_record *)ptr;
+			r->sz = sz[i];
+			r->addrsz = addrsz[i];
+			memcpy(r+1, &addr[i], addrsz[i]);
+			memcpy((char *)(r+1) + addrsz[i], p->udp_buffer + i * MAX_UDP_PACKAGE, sz[i]);
+			ptr += UDP_RECORD_SIZE(addrsz[i], sz[i]);
+		}
+
+		result_n(L, idx);
+		++ret;
+		++idx;
+		lua_pushinteger(L, s->id);
+		lua_rawseti(L, -2, 1);
+		lua_pushinteger(L, (int)total);
+		lua_rawseti(L, -2, 2);
+		lua_pushlightuserdata(L, buffer);
+		lua_rawseti(L, -2, 3);
+		lua_pop(L,1);
+
+		if (n < UDP_BATCH) {
+			return ret;
+		}
+	}
+}
+
+//udpдеݱ sendmmsg 
+static void
+sendout_udp(struct socket_pool *p, struct socket *s) {
+	struct udp_datagram d[UDP_BATCH];
+	while (s->head) {
+		int n = 0;
+		struct write_buffer * wb = s->head;
+		while (wb && n < UDP_BATCH) {
+			struct udp_record * r = wb->buffer;
+			d[n].addr = (const struct sockaddr *)(r+1);
+			d[n].addrsz = r->addrsz;
+			d[n].ptr = wb->ptr;
+			d[n].sz = wb->sz;
+			++n;
+			wb = wb->next;
+		}
+		int r = udp_sendbatch(s->fd, d, n);
+		if (r < 0) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			case EAGAIN:
+				return;
+			}
+			//ʧܵݱֱӶ
+			r = 1;
+		}
+		while (r-- > 0) {
+			wb = s->head;
+			s->head = wb->next;
+			wb_delete(p, wb);
+		}
+	}
+	s->tail = NULL;
+	//ٹעд¼
+	sp_write(p->fd, s->fd, s, false);
+}
+
+//ʱеڵĲ,رճʱ {id, -2}
+//շݵʱ仯˵µĳʱʱ¼ʱ
+static int
+timer_result(lua_State *L, int idx, struct socket_pool *p) {
+	int ret = 0;
+	uint64_t now = p->now;
+	if (now >= p->wheel_time + WHEEL_SIZE) {
+		//ʱ̫Զ,ÿֻҪһ
+		p->wheel_time = now - WHEEL_SIZE + 1;
+	}
+	while (p->wheel_time <= now) {
+		int slot = p->wheel_time % WHEEL_SIZE;
+		spin_lock(&p->timer_lock);
+		++p->wheel_time;
+		//Ƶ expiring ,ڼ߳ȻƳ¼
+		int index = p->wheel[slot];
+		p->wheel[slot] = -1;
+		p->expiring = index;
+		while (index >= 0) {
+			struct socket * s = slot_socket(p, index);
+			s->timer_slot = TIMER_EXPIRING;
+			index = s->timer_next;
+		}
+		spin_unlock(&p->timer_lock);
+
+		for (;;) {
+			spin_lock(&p->timer_lock);
+			index = p->expiring;
+			if (index < 0) {
+				spin_unlock(&p->timer_lock);
+				break;
+			}
+			struct socket * s = slot_socket(p, index);
+			timer_unlink(p, s);
+			spin_unlock(&p->timer_lock);
+
+			spin_lock(&s->lock);
+			if (s->status == STATUS_SUSPEND) {
+				uint64_t deadline = socket_deadline(s);
+				if (deadline <= now) {
+					int id = s->id;
+					force_close(s, p);
+					ret += drain_result(L, idx + ret, id, -2);
+				} else if (deadline != NO_DEADLINE) {
+					timer_add(p, s, deadline);
+				}
+			}
+			spin_unlock(&s->lock);
+		}
+	}
+	return ret;
+}
+
 //epoll_wait,ԻԾ¼   
 
 //luaʱ csocket.poll({})
@@ -600,7 +1696,7 @@ lpoll(lua_State *L) {
 		//{} {}<-{}
 		
 		//ӸԸ޸ĻӰ쵽ԭ
-		lua_pushvalue(L,-1)
+		lua_pushvalue(L,-1);
 		
 		//result[0]={}
 		//{0={}} {}  
@@ -614,8 +1710,25 @@ lpoll(lua_State *L) {
 	int i;
 	
 	int t = 1;
+	p->now = gettime();
+	admission_check(p);
 	for (i=0;i<n;i++) {
 		struct event *e = &p->ev[i];
+		if (IS_PIPE_TAG(e->s)) {
+			//ȴĹܵ,¹ע socket д, һοд¼з
+			struct socket *s = PIPE_SOCKET(e->s);
+			spin_lock(&s->lock);
+			if (s->pipe_wait) {
+				pipe_unwatch(p, s);
+				sp_write(p->fd, s->fd, s, true);
+			}
+			spin_unlock(&s->lock);
+			continue;
+		}
+		//ͬһ¼пѾر
+		if (((struct socket *)e->s)->status == STATUS_INVALID) {
+			continue;
+		}
 		//ɶ
 		if (e->read) {
 			struct socket * s= e->s;
@@ -624,6 +1737,8 @@ lpoll(lua_State *L) {
 				//Ǽɶ
 				//֮  {0={},1={1=s->id,2=id,3="......."}}  {} 
 				t += accept_result(L, t, e->s, p);
+			} else if (s->udp) {
+				t += udp_result(L, t, e->s, p);
 			} else {
 
 				// {0={},idx={1=s->sid,2=r,3=buffer}}  {}
@@ -634,17 +1749,36 @@ lpoll(lua_State *L) {
 		//д
 		if (e->write) {
 			struct socket *s = e->s;
+			spin_lock(&s->lock);
+			short status = s->status;
 			//ӦķͻȫͣҲټд¼
-			sendout(p, s);
+			if (s->udp) {
+				sendout_udp(p, s);
+			} else {
+				sendout(p, s);
+			}
+
+			if (status == STATUS_SUSPEND && s->status == STATUS_INVALID) {
+				//ͳر,֪ͨӵ {id, 0}
+				t += drain_result(L, t, s->id, 0);
+			} else if (s->blocked && (s->high_water == 0 || s->wb_size <= s->low_water)) {
+				//ˮλ,֪ͨȴд {id, -1}
+				s->blocked = 0;
+				t += drain_result(L, t, s->id, -1);
+			}
 
 			//֮ǰرʱΪдĻݣֻ Ҫر
  			if (s->status == STATUS_HALFCLOSE && s->head == NULL) {
 				//ر
 				force_close(s, p);
 			}
+			spin_unlock(&s->lock);
 		}
 	}
 
+	//ʱ
+	t += timer_result(L, t, p);
+
 	remove_after_n(L,t);
 
 	//Ԫصĸ
@@ -652,6 +1786,105 @@ lpoll(lua_State *L) {
 	return 1;
 }
 
+//дɿձΪǿ,ʼдʱ
+//ǰҪ s->lock
+static void
+write_pending(struct socket_pool *p, struct socket *s) {
+	s->last_write = p->now;
+	if (s->write_timeout) {
+		uint64_t deadline = s->last_write + s->write_timeout;
+		if (s->timer_slot == TIMER_OFF || deadline < socket_deadline(s)) {
+			timer_add(p, s, deadline);
+		}
+	}
+}
+
+//ӵдβ
+//msg  malloc ,дӹ; msg Ϊ NULL ʱ ptr ָݲ socket ,Ҫ
+//ǰҪ s->lock
+static void
+queue_write(struct socket_pool *p, struct socket *s, void *msg, const char *ptr, size_t sz) {
+	struct write_buffer * tail = s->tail;
+	struct write_buffer * buf;
+	s->wb_size += sz;
+	if (s->head == NULL) {
+		write_pending(p, s);
+	}
+	if (sz < SMALL_WRITE) {
+		//Сݾ׷ӵβĺϲ
+		if (tail && tail->cap && tail->ptr + tail->sz + sz <= (char *)tail->buffer + tail->cap) {
+			memcpy(tail->ptr + tail->sz, ptr, sz);
+			tail->sz += sz;
+			free(msg);
+			return;
+		}
+		buf = wb_new(p);
+		buf->buffer = malloc(MERGE_BUFFER);
+		buf->cap = MERGE_BUFFER;
+		buf->ptr = buf->buffer;
+		memcpy(buf->ptr, ptr, sz);
+		free(msg);
+	} else {
+		buf = wb_new(p);
+		if (msg == NULL) {
+			msg = malloc(sz);
+			memcpy(msg, ptr, sz);
+			ptr = msg;
+		}
+		buf->buffer = msg;
+		buf->ptr = (char *)ptr;
+	}
+	buf->sz = sz;
+
+	//뵽β
+	if (tail) {
+		assert(tail->next == NULL);
+		tail->next = buf;
+	} else {
+		s->head = buf;
+	}
+	s->tail = buf;
+}
+
+//дΪʱֱӷͣδݱ浽д
+//ǰҪ s->lock
+static void
+send_data(struct socket_pool *p, struct socket *s, void *msg, const char *ptr, size_t sz) {
+	//Ӧд,Ҫ͵ӵβ,ֱӷ 
+	if (s->head) {
+		queue_write(p, s, msg, ptr, sz);
+		return;
+	}
+
+	for (;;) {
+		//ֱӷ
+		int wt = send(s->fd, ptr, sz,0);
+		if (wt < 0) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			}
+			break;
+		}
+		s->last_write = p->now;
+		//ȫϣͷ
+		if (wt == sz) {
+			free(msg);
+			return;
+		}
+		sz-=wt;
+		ptr+=wt;
+
+		break;
+	}
+
+	//δݱ浽
+	queue_write(p, s, msg, ptr, sz);
+
+	//עд¼
+	sp_write(p->fd, s->fd, s, true);
+}
+
 //,ͨӦò(Ӧ׽)ݵͻ
 static int
 lsend(lua_State *L) {
@@ -669,161 +1902,485 @@ lsend(lua_State *L) {
 	void * msg = lua_touserdata(L,3);
 
 	//ͨidȡ λ
-	struct socket * s = p->s[id % p->cap];
+	struct socket * s = lock_socket(p, id);
 
-	if (id != s->id) {
+	if (s == NULL) {
 		free(msg);
 		return luaL_error(L,"Write to invalid socket %d", id);
 	}
 
-	//ûӵepollй,
-	if (s->status != STATUS_SUSPEND) {
+	//ûӵepollй,.  udp  socket д
+	if (s->status != STATUS_SUSPEND || s->listen || s->udp || sz <= 0) {
+		spin_unlock(&s->lock);
 		free(msg);
 //		return luaL_error(L,"Write to closed socket %d", id);
 		return 0;
 	}
 
-	
-	//Ӧд,Ҫ͵ӵβ,ֱӷ 
-	if (s->head) {
-		
-		struct write_buffer * buf = malloc(sizeof(*buf));
-		buf->ptr = msg;
-		buf->buffer = msg;
-		buf->sz = sz;
-		assert(s->tail != NULL);
-		assert(s->tail->next == NULL);
+	send_data(p, s, msg, msg, sz);
+	spin_unlock(&s->lock);
 
-		//뵽β
-		buf->next = s->tail->next;
-		s->tail->next = buf;
-		s->tail = buf;
-		return 0;
+	return 0;
+}
+
+//ӵӵcellֱд,socket cell   csocket.write(pool, fd, str)
+//дΪʱڵǰֱ߳ӷ,ֻзͲĲֲŻḴ
+//Ѿرʱ false; дˮλʱڶֵΪ true,ˮλ poll  {id, -1}
+static int
+lwrite(lua_State *L) {
+	struct socket_pool * p = lua_touserdata(L, 1);
+	if (p == NULL) {
+		return luaL_error(L, "Need socket pool at param 1");
+	}
+	int id = luaL_checkinteger(L,2);
+	size_t sz = 0;
+	const char * str = luaL_checklstring(L, 3, &sz);
+
+	struct socket * s = lock_socket(p, id);
+	if (s == NULL) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	if (s->status != STATUS_SUSPEND || s->listen || s->udp) {
+		spin_unlock(&s->lock);
+		lua_pushboolean(L, 0);
+		return 1;
 	}
+	if (sz > 0) {
+		send_data(p, s, NULL, str, sz);
+	}
+	int full = 0;
+	if (s->high_water && s->wb_size > s->high_water) {
+		s->blocked = 1;
+		full = 1;
+	}
+	spin_unlock(&s->lock);
 
-	//
-	char * ptr = msg;
+	lua_pushboolean(L, 1);
+	lua_pushboolean(L, full);
+	return 2;
+}
 
-	for (;;) {
-		//ֱӷ
-		int wt = send(s->fd, ptr, sz,0);
-		if (wt < 0) {
-			switch(errno) {
-			case EINTR:
-				continue;
-			}
-			break;
+//ӵӵcellзļ   csocket.sendfile(pool, fd, path_or_fd, offset, len)
+//ļд, socket cell ڿдʱ sendfile/splice ,ռдˮλ
+//ᱻ dup,ȻҪԼر; ܵӵǰλ÷ len ֽ,ʡ len ʱ͵ܵر
+//ɹ true,Ѿرշ false,ļʧܷ nil, err
+static int
+lsendfile(lua_State *L) {
+	struct socket_pool * p = lua_touserdata(L, 1);
+	if (p == NULL) {
+		return luaL_error(L, "Need socket pool at param 1");
+	}
+	int id = luaL_checkinteger(L,2);
+#if USE_SELECT
+	return luaL_error(L, "sendfile is not supported");
+#else
+	lua_Integer offset = luaL_optinteger(L,4,0);
+	lua_Integer len = luaL_optinteger(L,5,-1);
+	if (offset < 0) {
+		return luaL_error(L, "Invalid offset %d", (int)offset);
+	}
+	int file;
+	if (lua_type(L,3) == LUA_TSTRING) {
+		file = open(lua_tostring(L,3), O_RDONLY);
+	} else {
+		file = dup(luaL_checkinteger(L,3));
+	}
+	if (file < 0) {
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	struct stat st;
+	if (fstat(file, &st) != 0) {
+		close(file);
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(errno));
+		return 2;
+	}
+	size_t sz;
+	int pipe = S_ISFIFO(st.st_mode);
+	if (pipe) {
+#ifndef __linux__
+		close(file);
+		return luaL_error(L, "sendfile from pipe is not supported");
+#endif
+		sz = len < 0 ? FILE_UNTIL_EOF : (size_t)len;
+	} else if (S_ISREG(st.st_mode)) {
+		if (offset > st.st_size) {
+			offset = st.st_size;
 		}
-		//ȫϣͷ
-		if (wt == sz) {
-			return 0;
+		sz = len < 0 || len > st.st_size - offset ? st.st_size - offset : len;
+	} else {
+		close(file);
+		return luaL_error(L, "sendfile need a regular file or pipe");
+	}
+	if (sz == 0) {
+		close(file);
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+
+	struct socket * s = lock_socket(p, id);
+	if (s == NULL || s->status != STATUS_SUSPEND || s->listen || s->udp) {
+		if (s) {
+			spin_unlock(&s->lock);
 		}
-		sz-=wt;
-		ptr+=wt;
+		close(file);
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	struct write_buffer * buf = wb_new(p);
+	buf->ptr = NULL;
+	buf->sz = sz;
+	buf->file = file;
+	buf->pipe = pipe;
+	buf->offset = offset;
+	if (s->tail) {
+		s->tail->next = buf;
+	} else {
+		write_pending(p, s);
+		s->head = buf;
+	}
+	s->tail = buf;
+	// socket cell ڿдʱ
+	sp_write(p->fd, s->fd, s, true);
+	spin_unlock(&s->lock);
 
-		break;
+	lua_pushboolean(L, 1);
+	return 1;
+#endif
+}
+
+//óʱ   csocket.timeout(pool, fd, idle, read, write)
+//λ 0.01 ,Ϊ 0 ʾ,ʱ socket cell ر֪ͨӵ {id, -2}
+//ʱӵǰʱ俪ʼ
+static int
+ltimeout(lua_State *L) {
+	struct socket_pool * p = lua_touserdata(L, 1);
+	if (p == NULL) {
+		return luaL_error(L, "Need socket pool at param 1");
+	}
+	int id = luaL_checkinteger(L,2);
+	int idle = luaL_optinteger(L,3,0);
+	int read = luaL_optinteger(L,4,0);
+	int write = luaL_optinteger(L,5,0);
+	if (idle < 0 || read < 0 || write < 0) {
+		return luaL_error(L, "Invalid timeout");
 	}
+	struct socket * s = lock_socket(p, id);
+	if (s == NULL) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	if (s->status != STATUS_SUSPEND || s->listen || s->udp) {
+		spin_unlock(&s->lock);
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	s->idle_timeout = idle;
+	s->read_timeout = read;
+	s->write_timeout = write;
+	s->last_read = p->now;
+	if (s->head) {
+		s->last_write = p->now;
+	}
+	timer_add(p, s, socket_deadline(s));
+	spin_unlock(&s->lock);
+	lua_pushboolean(L, 1);
+	return 1;
+}
 
-	//δݱ浽
-	struct write_buffer * buf = malloc(sizeof(*buf));
-	buf->next = NULL;
-	buf->ptr = ptr;
-	buf->sz = sz;
-	buf->buffer = msg;
-	s->head = s->tail = buf;
+//дĸˮλ͵ˮλ   csocket.watermark(pool, fd, high, low)
+//high Ϊ 0 ʾ, low ĬΪ high  1/4
+static int
+lwatermark(lua_State *L) {
+	struct socket_pool * p = lua_touserdata(L, 1);
+	if (p == NULL) {
+		return luaL_error(L, "Need socket pool at param 1");
+	}
+	int id = luaL_checkinteger(L,2);
+	lua_Integer high = luaL_checkinteger(L,3);
+	lua_Integer low = luaL_optinteger(L,4,high/4);
+	if (high < 0 || low < 0 || (high && low > high)) {
+		return luaL_error(L, "Invalid watermark %d %d", (int)high, (int)low);
+	}
+	struct socket * s = lock_socket(p, id);
+	if (s == NULL) {
+		return 0;
+	}
+	s->high_water = high;
+	s->low_water = low;
+	if (s->status == STATUS_SUSPEND && s->blocked && (high == 0 || s->wb_size <= low)) {
+		//Ѿµĵˮλ,һοд¼֪ͨ
+		sp_write(p->fd, s->fd, s, true);
+	}
+	spin_unlock(&s->lock);
+	return 0;
+}
 
-	//עд¼
-	sp_write(p->fd, s->fd, s, true);
+//cellѾ׽ֵѡ   csocket.setopt(pool, fd, name, value)
+//Ƿóɹ,ǰƽֵ̨֧ѡ false
+static int
+lsetopt(lua_State *L) {
+	struct socket_pool * p = lua_touserdata(L, 1);
+	if (p == NULL) {
+		return luaL_error(L, "Need socket pool at param 1");
+	}
+	int id = luaL_checkinteger(L,2);
+	const char * name = luaL_checkstring(L,3);
+	int v = option_value(L, 4);
+	int level, opt;
+	struct socket * s = lock_socket(p, id);
+	if (s == NULL) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	int r = option_name(name, s->listen, &level, &opt);
+	int ok = 0;
+	if (r == 0 && s->status == STATUS_SUSPEND) {
+		ok = setsockopt(s->fd, level, opt, (void *)&v, sizeof(v)) == 0;
+		if (ok && s->listen && opt == TCP_NODELAY && level == IPPROTO_TCP) {
+			s->nodelay = v;
+		}
+	}
+	spin_unlock(&s->lock);
+	if (r < 0) {
+		return luaL_error(L, "Unknown socket option %s", name);
+	}
+	lua_pushboolean(L, ok);
+	return 1;
+}
 
+//ȡֵ opts[name] = high  {high, low}, low Ĭ high һ
+static void
+admission_threshold(lua_State *L, const char *name, size_t *high, size_t *low) {
+	lua_getfield(L, 1, name);
+	if (lua_istable(L, -1)) {
+		lua_rawgeti(L, -1, 1);
+		lua_rawgeti(L, -2, 2);
+		*high = luaL_checkinteger(L, -2);
+		*low = luaL_optinteger(L, -1, *high / 2);
+		lua_pop(L, 2);
+	} else {
+		*high = luaL_optinteger(L, -1, 0);
+		*low = *high / 2;
+	}
+	lua_pop(L, 1);
+	if (*low > *high) {
+		luaL_error(L, "Invalid admission %s : low %d > high %d", name, (int)*low, (int)*high);
+	}
+}
+
+//ý csocket.admission { mode = "pause" | "shed", pending = high | {high, low}, runnable = ..., memory = ... }
+//Ϊ nil ʱرս
+static int
+ladmission(lua_State *L) {
+	struct socket_pool * p = get_sp(L);
+	struct admission *a = &p->admission;
+	if (lua_isnoneornil(L, 1)) {
+		a->mode = ADMISSION_OFF;
+		a->overload = false;
+		admission_pause(p, false);
+		return 0;
+	}
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_getfield(L, 1, "mode");
+	const char * mode = luaL_optstring(L, -1, "pause");
+	int m;
+	if (strcmp(mode, "pause") == 0) {
+		m = ADMISSION_PAUSE;
+	} else if (strcmp(mode, "shed") == 0) {
+		m = ADMISSION_SHED;
+	} else {
+		return luaL_error(L, "Invalid admission mode %s", mode);
+	}
+	lua_pop(L, 1);
+	size_t pending_high, pending_low, runnable_high, runnable_low, memory_high, memory_low;
+	admission_threshold(L, "pending", &pending_high, &pending_low);
+	admission_threshold(L, "runnable", &runnable_high, &runnable_low);
+	admission_threshold(L, "memory", &memory_high, &memory_low);
+
+	//úµֵж
+	a->overload = false;
+	admission_pause(p, false);
+	a->mode = m;
+	a->pending_high = pending_high;
+	a->pending_low = pending_low;
+	a->runnable_high = runnable_high;
+	a->runnable_low = runnable_low;
+	a->memory_high = memory_high;
+	a->memory_low = memory_low;
+	a->memory_time = 0;
+	admission_check(p);
 	return 0;
 }
 
+//Ƶͳ,һű
+static int
+lload(lua_State *L) {
+	struct socket_pool * p = get_sp(L);
+	struct admission *a = &p->admission;
+	int pending, runnable;
+	cell_load(&pending, &runnable);
+	lua_createtable(L, 0, 8);
+	lua_pushboolean(L, a->overload);
+	lua_setfield(L, -2, "overload");
+	lua_pushinteger(L, a->overloads);
+	lua_setfield(L, -2, "overloads");
+	lua_pushinteger(L, a->accepted);
+	lua_setfield(L, -2, "accepted");
+	lua_pushinteger(L, a->shed);
+	lua_setfield(L, -2, "shed");
+	lua_pushinteger(L, pending);
+	lua_setfield(L, -2, "pending");
+	lua_pushinteger(L, runnable);
+	lua_setfield(L, -2, "runnable");
+	lua_pushinteger(L, a->memory_high ? a->memory : process_memory());
+	lua_setfield(L, -2, "memory");
+	lua_pushinteger(L, p->count);
+	lua_setfield(L, -2, "sockets");
+	return 1;
+}
+
+//socket_poolָ,cellֱд
+static int
+lpool(lua_State *L) {
+	struct socket_pool * p = get_sp(L);
+	lua_pushlightuserdata(L, p);
+	return 1;
+}
+
 // buffer support
 
+//յݿ,ֱʹ push_result  malloc ڴ,ٸ
+struct buffer_node {
+	struct buffer_node * next;
+	char * msg;
+	int sz;
+};
+
+//ɽյݿɵ
 struct socket_buffer {
-	int size;
-	int head;
-	int tail;
+	int size;		//ݵܳ
+	int offset;		//head ڵѾĳ
+	int scan;		//ӶλÿʼѾҹָĳ,´δ
+	int sep_sz;		//scan Ӧķָ
+	char sep[MAX_SEP];
+	struct buffer_node * head;
+	struct buffer_node * tail;
 };
 
-//struct socket_bufferֻǸûͷ  int szʵʵĴ洢ݵλ
+//ͷݿ
+static int
+lbuffer_gc(lua_State *L) {
+	struct socket_buffer * buffer = lua_touserdata(L, 1);
+	struct buffer_node * node = buffer->head;
+	while (node) {
+		struct buffer_node * tmp = node;
+		node = node->next;
+		free(tmp->msg);
+		free(tmp);
+	}
+	buffer->head = buffer->tail = NULL;
+	buffer->size = 0;
+	return 0;
+}
 
-//һsocket_buffer  СΪ sz
+//һsocket_buffer
 static struct socket_buffer *
-new_buffer(lua_State *L, int sz) {
-	//sizeof(*buffer) + sz
-	struct socket_buffer * buffer = lua_newuserdata(L, sizeof(*buffer) + sz);
-	buffer->size = sz;
-	buffer->head = 0;
-	buffer->tail = 0;
+new_buffer(lua_State *L) {
+	struct socket_buffer * buffer = lua_newuserdata(L, sizeof(*buffer));
+	memset(buffer, 0, sizeof(*buffer));
+	if (luaL_newmetatable(L, "socket_buffer")) {
+		lua_pushcfunction(L, lbuffer_gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
 
 	return buffer;
 }
 
-//
+//λ֮ sz ֽ
 static void
-copy_buffer(struct socket_buffer * dest, struct socket_buffer * src) {
-
-	char * ptr = (char *)(src+1);
-	
-	if (src->tail >= src->head) {
-
-		//С
-		int sz = src->tail - src->head;
-
-		memcpy(dest+1, ptr+ src->head, sz);
-
-		dest->tail = sz;
-	} 
-	else 
-	{
-		char * d = (char *)(dest+1);
-		int part = src->size - src->head;
-		memcpy(d, ptr + src->head, part);
-		memcpy(d + part, ptr , src->tail);
-		dest->tail = src->tail + part;
+buffer_skip(struct socket_buffer * buffer, int sz) {
+	buffer->size -= sz;
+	buffer->scan = buffer->scan > sz ? buffer->scan - sz : 0;
+	while (sz > 0) {
+		struct buffer_node * node = buffer->head;
+		int part = node->sz - buffer->offset;
+		if (sz < part) {
+			buffer->offset += sz;
+			return;
+		}
+		sz -= part;
+		buffer->head = node->next;
+		buffer->offset = 0;
+		free(node->msg);
+		free(node);
+	}
+	if (buffer->head == NULL) {
+		buffer->tail = NULL;
 	}
 }
 
-//socket_buffer
+//λ֮ sz ֽΪַѹջ
 static void
-append_buffer(struct socket_buffer * buffer, char * msg, int sz) {
-	char * dst = (char *)(buffer + 1);
-
-	//ӵ
-	if (sz + buffer->tail < buffer->size) {
-		memcpy(dst + buffer->tail , msg, sz);
-		buffer->tail += sz;
-	} else {
-		int part = buffer->size - buffer->tail;
-		
-		memcpy(dst + buffer->tail , msg, part);
-
-		memcpy(dst, msg + part, sz - part);
-		buffer->tail = sz - part;
+buffer_push(lua_State *L, struct socket_buffer * buffer, int sz) {
+	struct buffer_node * node = buffer->head;
+	if (sz == 0) {
+		lua_pushlstring(L, "", 0);
+		return;
+	}
+	//ͬһݿ
+	if (node->sz - buffer->offset >= sz) {
+		lua_pushlstring(L, node->msg + buffer->offset, sz);
+		return;
+	}
+	luaL_Buffer b;
+	luaL_buffinit(L, &b);
+	int offset = buffer->offset;
+	while (sz > 0) {
+		int part = node->sz - offset;
+		if (part > sz) {
+			part = sz;
+		}
+		luaL_addlstring(&b, node->msg + offset, part);
+		sz -= part;
+		offset = 0;
+		node = node->next;
 	}
+	luaL_pushresult(&b);
 }
 
+//ƶλ֮ sz ֽ,ƶλ
+static void
+buffer_peek(struct socket_buffer * buffer, char * out, int sz) {
+	struct buffer_node * node = buffer->head;
+	int offset = buffer->offset;
+	while (sz > 0) {
+		int part = node->sz - offset;
+		if (part > sz) {
+			part = sz;
+		}
+		memcpy(out, node->msg + offset, part);
+		out += part;
+		sz -= part;
+		offset = 0;
+		node = node->next;
+	}
+}
 
-//socket_buffer
+//socket_bufferݿ,msg ɻӹ
 static int
 lpush(lua_State *L) {
 	struct socket_buffer * buffer = lua_touserdata(L, 1);
 
-	//socket_bufferݵĴС
-	int bytes = 0;
-	if (buffer) {
-		bytes = buffer->tail - buffer->head;
-		if (bytes < 0) {
-			bytes += buffer->size;
-		}
-	}
-
 	//luaݵ
 	void * msg = lua_touserdata(L,2);
 	if (msg == NULL) {
 		lua_settop(L,1);
-		lua_pushinteger(L,bytes);
+		lua_pushinteger(L, buffer ? buffer->size : 0);
 		return 2;
 	}
 
@@ -831,24 +2388,24 @@ lpush(lua_State *L) {
 	int sz = luaL_checkinteger(L,3);
 
 	if (buffer == NULL) {
-		struct socket_buffer * nbuf = new_buffer(L, sz * 2);
-		append_buffer(nbuf, msg, sz);
-	}
-	//С,µ
-	else if (sz + bytes >= buffer->size) 
-	{
-		struct socket_buffer * nbuf = new_buffer(L, (sz + bytes) * 2);
-		copy_buffer(nbuf, buffer);
-		append_buffer(nbuf, msg, sz);
-	}
-	//ֱ
-	else 
-	{
+		buffer = new_buffer(L);
+	} else {
 		lua_settop(L,1);
-		append_buffer(buffer, msg, sz);
 	}
-	lua_pushinteger(L, sz + bytes);
-	free(msg);
+
+	struct buffer_node * node = malloc(sizeof(*node));
+	node->next = NULL;
+	node->msg = msg;
+	node->sz = sz;
+	if (buffer->tail) {
+		buffer->tail->next = node;
+	} else {
+		buffer->head = node;
+	}
+	buffer->tail = node;
+	buffer->size += sz;
+
+	lua_pushinteger(L, buffer->size);
 	return 2;
 }
 
@@ -863,11 +2420,8 @@ lpop(lua_State *L) {
 	//õҪݵĴС
 	int sz = luaL_checkinteger(L, 2);
 
-	//õг
-	int	bytes = buffer->tail - buffer->head;
-	if (bytes < 0) {
-		bytes += buffer->size;
-	}
+	//õг
+	int	bytes = buffer->size;
 
 	if (sz > bytes || bytes == 0) {
 		lua_pushnil(L);
@@ -879,47 +2433,95 @@ lpop(lua_State *L) {
 		sz = bytes;
 	}
 
-	char * ptr = (char *)(buffer+1);
-	if (buffer->size - buffer->head >=sz) {
-		lua_pushlstring(L, ptr + buffer->head, sz);
-		buffer->head+=sz;
-	} else {
-		luaL_Buffer b;
-		luaL_buffinit(L, &b);
-		luaL_addlstring(&b, ptr + buffer->head, buffer->size - buffer->head);
-		buffer->head = sz - (buffer->size - buffer->head);
-		luaL_addlstring(&b, ptr, buffer->head);
-		luaL_pushresult(&b);
-	}
+	buffer_push(L, buffer, sz);
+	buffer_skip(buffer, sz);
 
-	bytes -= sz;
-
-	lua_pushinteger(L,bytes);
-	if (bytes == 0) {
-		buffer->head = buffer->tail = 0;
-	}
+	lua_pushinteger(L, buffer->size);
 	
 	return 2;
 }
 
+//Ƚ϶λ֮ from ֽڿʼǷǷָ
 static inline int
 check_sep(struct socket_buffer *buffer, int from, const char * sep, int sz) {
-	const char * ptr = (const char *)(buffer+1);
+	struct buffer_node * node = buffer->head;
+	int offset = buffer->offset + from;
 	int i;
 	for (i=0;i<sz;i++) {
-		int index = from + i;
-		if (index >= buffer->size) {
-			index %= buffer->size;
+		while (offset >= node->sz) {
+			offset -= node->sz;
+			node = node->next;
 		}
-		
-		if (ptr[index] != sep[i]) {
+		if (node->msg[offset] != sep[i]) {
 			return 0;
 		}
+		++offset;
 	}
 	return 1;
 }
 
-//
+//ϴβҽλÿʼҷָ, memchr ҷָĵһֽ
+//طָԶλõƫ,Ҳ -1
+static int
+find_sep(struct socket_buffer *buffer, const char * sep, int len) {
+	int last = buffer->size - len;
+	int pos = buffer->scan;
+	if (len == 0) {
+		return 0;
+	}
+	//˷ָ,Ҫ²
+	if (len > MAX_SEP || len != buffer->sep_sz || memcmp(sep, buffer->sep, len) != 0) {
+		pos = 0;
+		if (len <= MAX_SEP) {
+			buffer->sep_sz = len;
+			memcpy(buffer->sep, sep, len);
+		} else {
+			buffer->sep_sz = 0;
+		}
+	}
+	if (pos > last) {
+		return -1;
+	}
+
+	//ҵ pos ڵݿ, base ݿʼλԶλõƫ
+	struct buffer_node * node = buffer->head;
+	int base = -buffer->offset;
+	while (base + node->sz <= pos) {
+		base += node->sz;
+		node = node->next;
+	}
+
+	while (node && pos <= last) {
+		const char * begin = node->msg + (pos - base);
+		const char * p = memchr(begin, sep[0], node->sz - (pos - base));
+		if (p == NULL) {
+			base += node->sz;
+			pos = base;
+			node = node->next;
+			continue;
+		}
+		pos = base + (int)(p - node->msg);
+		if (pos > last) {
+			break;
+		}
+		if (len == 1 || check_sep(buffer, pos, sep, len)) {
+			buffer->scan = buffer->sep_sz ? pos : 0;
+			return pos;
+		}
+		++pos;
+		if (pos - base >= node->sz) {
+			base += node->sz;
+			node = node->next;
+		}
+	}
+
+	//last ֮ǰǷָʼλ
+	buffer->scan = buffer->sep_sz ? last + 1 : 0;
+	return -1;
+}
+
+//ȡһ,check Ϊ true ʱֻǷһ
+//Ҳָݳ limit ʱ false
 static int
 lreadline(lua_State *L) {
 	struct socket_buffer * buffer = lua_touserdata(L, 1);
@@ -931,54 +2533,94 @@ lreadline(lua_State *L) {
 	
 	int read = !lua_toboolean(L,3);
 
-	//õг 
-	int	bytes = buffer->tail - buffer->head;
+	int limit = luaL_optinteger(L,4,MAX_LINE);
+
+	int pos = find_sep(buffer, sep, (int)len);
+	if (pos < 0) {
+		if (buffer->size - (int)len >= limit) {
+			lua_pushboolean(L,0);
+			return 1;
+		}
+		return 0;
+	}
 
-	if (bytes < 0) {
-		bytes += buffer->size;
+	if (read == 0) {
+		lua_pushboolean(L,1);
+	} else {
+		buffer_push(L, buffer, pos);
+		buffer_skip(buffer, pos + (int)len);
 	}
+	return 1;
+}
 
+//ȡͷеİ峤,ͷûȫʱ false
+static bool
+packet_size(struct socket_buffer *buffer, int header, bool little, uint32_t *sz) {
+	uint8_t h[4];
+	if (buffer->size < header) {
+		return false;
+	}
+	buffer_peek(buffer, (char *)h, header);
+	if (header == 2) {
+		*sz = little ? (h[0] | h[1] << 8) : (h[0] << 8 | h[1]);
+	} else if (little) {
+		*sz = (uint32_t)h[0] | (uint32_t)h[1] << 8 | (uint32_t)h[2] << 16 | (uint32_t)h[3] << 24;
+	} else {
+		*sz = (uint32_t)h[0] << 24 | (uint32_t)h[1] << 16 | (uint32_t)h[2] << 8 | (uint32_t)h[3];
+	}
+	return true;
+}
+
+//ȡ 2  4 ֽڳΪͷݰ    readpacket(buffer, header, endian, check, n, limit)
+//check Ϊ true ʱֻǷİ,෵ n İ
+//ͷеĳȳ limit ʱ false
+static int
+lreadpacket(lua_State *L) {
+	struct socket_buffer * buffer = lua_touserdata(L, 1);
+	if (buffer == NULL) {
+		return 0;
+	}
+	int header = luaL_optinteger(L, 2, 2);
+	if (header != 2 && header != 4) {
+		return luaL_error(L, "Invalid packet header size %d", header);
+	}
+	const char * endian = luaL_optstring(L, 3, "big");
+	bool little = endian[0] == 'l';
+	int check = lua_toboolean(L, 4);
+	int n = luaL_optinteger(L, 5, 1);
+	//buffer_push ĳ int
+	lua_Integer limit = luaL_optinteger(L, 6, MAX_PACKET);
+	if (limit < 0 || limit > INT_MAX - 4) {
+		limit = INT_MAX - 4;
+	}
 
 	int i;
-	for (i=0;i<=bytes-(int)len;i++) {
-		int index = buffer->head + i;
-		if (index >= buffer->size) {
-			index -= buffer->size;
+	for (i=0;i<n;i++) {
+		uint32_t sz;
+		if (!packet_size(buffer, header, little, &sz)) {
+			break;
 		}
-
-		if (check_sep(buffer, index, sep, (int)len)) {
-			
-			if (read == 0) {
-				lua_pushboolean(L,1);
-			} else {
-				if (i==0) {
-					lua_pushlstring(L, "", 0);
-				} else {
-					const char * ptr = (const char *)(buffer+1);
-					if (--index < 0) {
-						index = buffer->size -1;
-					}
-					if (index < buffer->head) {
-						luaL_Buffer b;
-						luaL_buffinit(L, &b);
-						luaL_addlstring(&b, ptr + buffer->head, buffer->size-buffer->head);
-						luaL_addlstring(&b, ptr, index+1);
-						luaL_pushresult(&b);
-					} else {
-						lua_pushlstring(L, ptr + buffer->head, index-buffer->head+1);
-					}
-					++index;
-				}
-				index+=len;
-				if (index >= buffer->size) {
-					index-=buffer->size;
-				}
-				buffer->head = index;
+		if ((lua_Integer)sz > limit) {
+			//ͷеĳȳ, ǰѾİȷ
+			if (i == 0) {
+				lua_pushboolean(L,0);
+				return 1;
 			}
+			break;
+		}
+		if ((uint32_t)(buffer->size - header) < sz) {
+			break;
+		}
+		if (check) {
+			lua_pushboolean(L,1);
 			return 1;
 		}
+		luaL_checkstack(L, 1, NULL);
+		buffer_skip(buffer, header);
+		buffer_push(L, buffer, (int)sz);
+		buffer_skip(buffer, (int)sz);
 	}
-	return 0;
+	return i;
 }
 
 //msgڴ
@@ -1003,68 +2645,74 @@ lfreepack(lua_State *L) {
 }
 
 // server support
+
 // socket  bind  listen,뵽epoll,struct socket_pool
 ///ؼ׽ֶӦӦò
+//csocket.listen(addr, opts) opts  set_options,֧ backlog
 static int
 llisten(lua_State *L) {
 	struct socket_pool * p = get_sp(L);
-	// only support ipv4
-	int port = 0;
 	size_t len = 0;
 	const char * name = luaL_checklstring(L, 1, &len);
-	char binding[len+1];
-	memcpy(binding, name, len+1);
-	char * portstr = strchr(binding,':');
-	uint32_t addr = INADDR_ANY;
-	if (portstr == NULL) {
-		port = strtol(binding, NULL, 10);
-		if (port <= 0) {
-			return luaL_error(L, "Invalid address %s", name);
-		}
-	} else {
-		//˿
-		port = strtol(portstr + 1, NULL, 10);
-		if (port <= 0) {
-			return luaL_error(L, "Invalid address %s", name);
-		}
-		portstr[0] = '\0';
-		addr=inet_addr(binding);
+	struct sockaddr_storage my_addr;
+	socklen_t addrsz = parse_address(L, name, len, &my_addr);
+	int backlog = BACKLOG;
+	int nodelay = 0;
+	check_options(L, 2);
+	if (!lua_isnoneornil(L, 2)) {
+		lua_getfield(L, 2, "backlog");
+		backlog = luaL_optinteger(L, -1, BACKLOG);
+		lua_getfield(L, 2, "nodelay");
+		nodelay = lua_toboolean(L, -1);
+		lua_pop(L, 2);
 	}
 
 	//socket
-	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	int listen_fd = socket(my_addr.ss_family, SOCK_STREAM, 0);
 
 	//뵽socket_poolУ뵽epollй
-	int id = new_socket(p, listen_fd);
+	int id = new_socket(p, listen_fd, false);
 	if (id < 0) {
 		return luaL_error(L, "Create socket %s failed", name);
 	}
 	
-	struct socket * s = p->s[id % p->cap];
+	struct socket * s = slot_socket(p, SLOT_INDEX(id));
 
 
 	//Ϊ׽
 	s->listen = 1;
-
-	//õַظ
-	int reuse = 1;
-	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, (void *)&reuse, sizeof(int));
-
-	struct sockaddr_in my_addr;
-	memset(&my_addr, 0, sizeof(struct sockaddr_in));
-	my_addr.sin_family = AF_INET;
-	my_addr.sin_port = htons(port);
-	my_addr.sin_addr.s_addr = addr;
+	s->nodelay = nodelay;
+
+#if !USE_SELECT
+	if (my_addr.ss_family == AF_UNIX) {
+		//ɾϴ׽ļ,ռûļ
+		struct sockaddr_un * un = (struct sockaddr_un *)&my_addr;
+		if (un->sun_path[0]) {
+			unlink(un->sun_path);
+		}
+	} else
+#endif
+	{
+		//õַظ
+		int reuse = 1;
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, (void *)&reuse, sizeof(int));
+	}
 
 	//
-	if (bind(listen_fd, (struct sockaddr *)&my_addr, sizeof(struct sockaddr)) == -1) {
+	if (bind(listen_fd, (struct sockaddr *)&my_addr, addrsz) == -1) {
+		spin_lock(&s->lock);
 		force_close(s,p);
+		spin_unlock(&s->lock);
 		return luaL_error(L, "Bind %s failed", name);
 	}
 
+	set_options(L, 2, listen_fd, true);
+
 	//Ϊ
-	if (listen(listen_fd, BACKLOG) == -1) {
+	if (listen(listen_fd, backlog) == -1) {
+		spin_lock(&s->lock);
 		force_close(s,p);
+		spin_unlock(&s->lock);
 		return luaL_error(L, "Listen %s failed", name);
 	}
 
@@ -1073,6 +2721,189 @@ llisten(lua_State *L) {
 	return 1;
 }
 
+//udp׽ֲ󶨵ַ(ʽͬ listen),뵽epoll,struct socket_pool
+//udp׽ֶӦӦò
+static int
+ludp(lua_State *L) {
+	struct socket_pool * p = get_sp(L);
+	size_t len = 0;
+	const char * name = luaL_checklstring(L, 1, &len);
+	struct sockaddr_storage my_addr;
+	socklen_t addrsz = parse_address(L, name, len, &my_addr);
+
+	if (p->udp_buffer == NULL) {
+		p->udp_buffer = malloc(UDP_BATCH * MAX_UDP_PACKAGE);
+	}
+
+	int fd = socket(my_addr.ss_family, SOCK_DGRAM, 0);
+	int id = new_socket(p, fd, false);
+	if (id < 0) {
+		return luaL_error(L, "Create socket %s failed", name);
+	}
+	struct socket * s = slot_socket(p, SLOT_INDEX(id));
+	s->udp = 1;
+
+	if (bind(fd, (struct sockaddr *)&my_addr, addrsz) == -1) {
+		spin_lock(&s->lock);
+		force_close(s,p);
+		spin_unlock(&s->lock);
+		return luaL_error(L, "Bind %s failed", name);
+	}
+
+	lua_pushinteger(L, id);
+	return 1;
+}
+
+//udpݱд,ַݶᱻ
+//ǰҪ s->lock
+static void
+queue_udp(struct socket_pool *p, struct socket *s, struct udp_datagram *d) {
+	struct write_buffer * buf = wb_new(p);
+	struct udp_record * r = malloc(sizeof(*r) + d->addrsz + d->sz);
+	r->sz = d->sz;
+	r->addrsz = d->addrsz;
+	memcpy(r+1, d->addr, d->addrsz);
+	buf->buffer = r;
+	buf->ptr = (char *)(r+1) + d->addrsz;
+	memcpy(buf->ptr, d->ptr, d->sz);
+	buf->sz = d->sz;
+	if (s->tail) {
+		s->tail->next = buf;
+	} else {
+		s->head = buf;
+	}
+	s->tail = buf;
+}
+
+//cellֱӷudpݱ   csocket.sendto(pool, fd, addr, data, addr, data, ...)
+//addr  csocket.udpaddress  udpunpack صĵַ,ݱ sendmmsg 
+//׽Ѿرʱ false
+static int
+lsendto(lua_State *L) {
+	struct socket_pool * p = lua_touserdata(L, 1);
+	if (p == NULL) {
+		return luaL_error(L, "Need socket pool at param 1");
+	}
+	int id = luaL_checkinteger(L, 2);
+	int top = lua_gettop(L);
+	if (top < 4 || (top & 1)) {
+		return luaL_error(L, "Need address and data pairs");
+	}
+	int n = (top - 2) / 2;
+	int i;
+	for (i=3;i<=top;i++) {
+		luaL_checktype(L, i, LUA_TSTRING);
+	}
+
+	struct socket * s = lock_socket(p, id);
+	if (s == NULL) {
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	if (s->status != STATUS_SUSPEND || !s->udp) {
+		spin_unlock(&s->lock);
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+
+	struct udp_datagram d[UDP_BATCH];
+	i = 0;
+	while (i < n) {
+		int batch = n - i;
+		if (batch > UDP_BATCH) {
+			batch = UDP_BATCH;
+		}
+		int j;
+		for (j=0;j<batch;j++) {
+			size_t sz = 0;
+			d[j].addr = (const struct sockaddr *)lua_tolstring(L, 3 + (i+j) * 2, &sz);
+			d[j].addrsz = sz;
+			d[j].ptr = lua_tolstring(L, 4 + (i+j) * 2, &d[j].sz);
+		}
+		//д,˳ں
+		if (s->head) {
+			for (j=0;j<batch;j++) {
+				queue_udp(p, s, &d[j]);
+			}
+			i += batch;
+			continue;
+		}
+		int r = udp_sendbatch(s->fd, d, batch);
+		if (r < 0) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			case EAGAIN:
+				queue_udp(p, s, &d[0]);
+				//עд¼
+				sp_write(p->fd, s->fd, s, true);
+				r = 1;
+				break;
+			default:
+				//ʧܵݱֱӶ
+				r = 1;
+				break;
+			}
+		}
+		i += r;
+	}
+	spin_unlock(&s->lock);
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+//⿪ udp_result ݿ, data1, from1, data2, from2 ...  ͷݿ
+static int
+ludpunpack(lua_State *L) {
+	char * msg = lua_touserdata(L, 1);
+	int sz = luaL_checkinteger(L, 2);
+	char * ptr = msg;
+	int n = 0;
+	while (ptr < msg + sz) {
+		struct udp_record * r = (struct udp_record *)ptr;
+		luaL_checkstack(L, 2, NULL);
+		lua_pushlstring(L, (char *)(r+1) + r->addrsz, r->sz);
+		lua_pushlstring(L, (char *)(r+1), r->addrsz);
+		n += 2;
+		ptr += UDP_RECORD_SIZE(r->addrsz, r->sz);
+	}
+	free(msg);
+	return n;
+}
+
+// host, port ת sendto ʹõĵַ
+static int
+ludpaddress(lua_State *L) {
+	const char * host = luaL_checkstring(L, 1);
+	const char * port = luaL_checkstring(L, 2);
+	struct addrinfo ai_hints;
+	struct addrinfo *ai_list = NULL;
+	memset(&ai_hints, 0, sizeof(ai_hints));
+	ai_hints.ai_family = AF_UNSPEC;
+	ai_hints.ai_socktype = SOCK_DGRAM;
+	ai_hints.ai_protocol = IPPROTO_UDP;
+	if (getaddrinfo(host, port, &ai_hints, &ai_list) != 0) {
+		return 0;
+	}
+	lua_pushlstring(L, (const char *)ai_list->ai_addr, ai_list->ai_addrlen);
+	freeaddrinfo(ai_list);
+	return 1;
+}
+
+// udp ַת ip, port
+static int
+ludpname(lua_State *L) {
+	size_t sz = 0;
+	const char * addr = luaL_checklstring(L, 1, &sz);
+	struct sockaddr_storage sa;
+	if (sz < sizeof(sa.ss_family) || sz > sizeof(sa)) {
+		return 0;
+	}
+	memcpy(&sa, addr, sz);
+	return push_address(L, (struct sockaddr *)&sa, sz);
+}
+
 int 
 socket_lib(lua_State *L) {
 	luaL_checkversion(L);
@@ -1082,12 +2913,26 @@ socket_lib(lua_State *L) {
 		{ "close", lclose },
 		{ "poll", lpoll },
 		{ "send", lsend },
+		{ "write", lwrite },
+		{ "watermark", lwatermark },
+		{ "sendfile", lsendfile },
+		{ "timeout", ltimeout },
+		{ "setopt", lsetopt },
+		{ "pool", lpool },
+		{ "admission", ladmission },
+		{ "load", lload },
 		{ "sendpack", lsendpack },
 		{ "freepack", lfreepack },
 		{ "push", lpush },
 		{ "pop", lpop },
 		{ "readline", lreadline },
+		{ "readpacket", lreadpacket },
 		{ "listen", llisten },
+		{ "udp", ludp },
+		{ "sendto", lsendto },
+		{ "udpunpack", ludpunpack },
+		{ "udpaddress", ludpaddress },
+		{ "udpname", ludpname },
 		{ NULL, NULL },
 	};
 
@@ -5,14 +5,22 @@
 #include "hive_cell.h"
 #include "hive_scheduler.h"
 #include "hive_system_lib.h"
+#include "hive_alloc.h"
+#include "hive_cache.h"
+
+#include <stdlib.h>
 
 
 //һµlua_State
 static int
 llaunch(lua_State *L) {
-	//ȡļ  test/main.lua
-	const char * filename = luaL_checkstring(L,1);
-	lua_State *sL = scheduler_newtask(L);
+	//ģ test.main,  package.path вҶӦļ test/main.lua
+	const char * name = luaL_checkstring(L,1);
+	const char * filename = hive_searchpath(L, name);
+	if (filename == NULL) {
+		return luaL_error(L, "cell %s was not found", name);
+	}
+	lua_State *sL = scheduler_newtask(L, scheduler_libs(L, 2));
 	
 	//ִfilenameӦļ  test/main.lua
 	struct cell * c = cell_new(sL, filename);
@@ -37,6 +45,51 @@ lkill(lua_State *L) {
 	return 0;
 }
 
+//ڴͳ { total = lua ʹõֽ, pool = ռõֽ, cells = { [cell] = ֽ } }
+static int
+lmemory(lua_State *L) {
+	struct hive_alloc_info * info = NULL;
+	int n = hive_alloc_collect(&info);
+	size_t total = 0;
+	size_t pool = 0;
+	lua_createtable(L, 0, 3);
+	lua_createtable(L, 0, n);
+	int i;
+	for (i=0;i<n;i++) {
+		total += info[i].used;
+		pool += info[i].pool;
+		cell_touserdata(L, lua_upvalueindex(1), info[i].owner);
+		lua_pushinteger(L, info[i].used);
+		lua_rawset(L, -3);
+		cell_release(info[i].owner);
+	}
+	free(info);
+	lua_setfield(L, -2, "cells");
+	lua_pushinteger(L, total);
+	lua_setfield(L, -2, "total");
+	lua_pushinteger(L, pool);
+	lua_setfield(L, -2, "pool");
+	return 1;
+}
+
+// cell ڴ(ֽ), 0 ʾ. ʱ cell еڴʧ
+static int
+lmemlimit(lua_State *L) {
+	struct cell * c = cell_fromuserdata(L, 1);
+	if (c == NULL) {
+		return luaL_error(L, "Need cell object at param 1");
+	}
+	lua_pushboolean(L, hive_alloc_setlimit(c, luaL_optinteger(L, 2, 0)));
+	return 1;
+}
+
+//ֽ뻺, ޸Ĺ cell ļ´ launch ʱ¼
+static int
+lclearcache(lua_State *L) {
+	hive_cache_clear();
+	return 0;
+}
+
 //ʼ
 static int
 linit(lua_State *L) {
@@ -52,12 +105,17 @@ cell_system_lib(lua_State *L) {
 	luaL_Reg l[] = {
 		{ "kill", lkill },
 		{ "init", linit },
+		{ "memlimit", lmemlimit },
+		{ "clearcache", lclearcache },
 		{ NULL, NULL },
 	};
 	luaL_newlib(L,l);
 	hive_getenv(L, "cell_map");
 	lua_pushcclosure(L, llaunch, 1);
 	lua_setfield(L, -2, "launch");
+	hive_getenv(L, "cell_map");
+	lua_pushcclosure(L, lmemory, 1);
+	lua_setfield(L, -2, "memory");
 	return 1;
 }
 
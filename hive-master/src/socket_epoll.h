@@ -4,7 +4,10 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <signal.h>
@@ -7,7 +7,10 @@
 #include <signal.h>
 #include <sys/time.h>
 #include <sys/event.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 
 static bool 
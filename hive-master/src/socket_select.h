@@ -21,7 +21,10 @@ struct socket_fd {
 };
 
 
+//cell ֱдʱԼĹ߳е sp_write (رճʱ sp_del),
+// socket cell е sp_wait ͬʱ޸, Ҫ
 struct select_pool {
+	int lock;
 	int select_n;	//еʼλ
 	int cap;		//socket_fd
 	int socket_n;	//һЧݵλ
@@ -40,6 +43,16 @@ _expand(struct select_pool *p) {
 	p->socket_n = 0;
 }
 
+static inline void
+sp_lock(struct select_pool *sp) {
+	while (__sync_lock_test_and_set(&sp->lock,1)) {}
+}
+
+static inline void
+sp_unlock(struct select_pool *sp) {
+	__sync_lock_release(&sp->lock);
+}
+
 static bool 
 sp_invalid(struct select_pool *sp) {
 	return sp == NULL;
@@ -54,6 +67,7 @@ sp_init() {
 static struct select_pool *
 sp_create() {
 	struct select_pool * sp = malloc(sizeof(*sp));
+	sp->lock = 0;
 	sp->cap = DEFAULT_CAP;
 	sp->fd = malloc(sp->cap * sizeof(struct socket_fd));
 	sp->select_n = 0;
@@ -78,6 +92,7 @@ sp_release(struct select_pool *sp) {
 //
 static int 
 sp_add(struct select_pool *sp, int sock, void *ud) {
+	sp_lock(sp);
 
 	//ж
 	if (sp->socket_n >= sp->cap) {
@@ -92,6 +107,7 @@ sp_add(struct select_pool *sp, int sock, void *ud) {
 
 	//ǷҪд¼
 	sp->fd[n].write = false;
+	sp_unlock(sp);
 	return 0;
 }
 
@@ -100,6 +116,7 @@ static void
 sp_del(struct select_pool *sp, int sock) {
 	int i;
 	bool move = false;
+	sp_lock(sp);
 	for (i=0;i<sp->socket_n;i++) {
 		if (move) {
 			sp->fd[i-1] = sp->fd[i];
@@ -112,18 +129,21 @@ sp_del(struct select_pool *sp, int sock) {
 		//Чλ-1
 		sp->socket_n--;
 	}
+	sp_unlock(sp);
 }
 
 //޸д
 static void 
 sp_write(struct select_pool *sp, int sock, void *ud, bool enable) {
 	int i;
+	sp_lock(sp);
 	for (i=0;i<sp->socket_n;i++) {
 		if (sp->fd[i].fd == sock) {
 			sp->fd[i].write = enable;
-			return;
+			break;
 		}
 	}
+	sp_unlock(sp);
 }
 
 //select    nÿμ
@@ -145,8 +165,9 @@ sp_wait(struct select_pool *sp, struct event *e, int n, int timeout) {
 		FD_ZERO(&rd);
 		FD_ZERO(&wt);
 
-		//ÿѡȡn
+		//ÿѡȡn, select ʱ
 		int i;
+		sp_lock(sp);
 		for (i=0;i<n;i++) {
 			int idx = sp->select_n+i;
 			
@@ -161,10 +182,12 @@ sp_wait(struct select_pool *sp, struct event *e, int n, int timeout) {
 				FD_SET(sp->fd[idx].fd, &wt);
 			}
 		}
+		sp_unlock(sp);
 
 		//select
 		int ret = select(i+1, &rd, &wt, NULL, &ti);
 		
+		sp_lock(sp);
 		if (ret <= 0) {
 			ti.tv_sec = 0;
 			ti.tv_usec = 0;
@@ -172,8 +195,10 @@ sp_wait(struct select_pool *sp, struct event *e, int n, int timeout) {
 			sp->select_n += n;
 			if (sp->select_n >= sp->socket_n) {
 				sp->select_n = 0;
+				sp_unlock(sp);
 				return ret;
 			}
+			sp_unlock(sp);
 		} else {
 		
 			int t = 0;
@@ -205,7 +230,8 @@ sp_wait(struct select_pool *sp, struct event *e, int n, int timeout) {
 						break;
 				}
 			}
-			assert(t==ret);
+			//select ڼ߳̿ɾ, t С ret
+			sp_unlock(sp);
 			return t;
 		}
 	}
@@ -218,4 +244,25 @@ sp_nonblocking(int sock) {
 	ioctlsocket(sock,FIONBIO,&flag);
 }
 
+//windows û writev WSASend 
+struct iovec {
+	void * iov_base;
+	size_t iov_len;
+};
+
+static int
+writev(int sock, const struct iovec *iov, int n) {
+	WSABUF buf[n];
+	int i;
+	for (i=0;i<n;i++) {
+		buf[i].buf = iov[i].iov_base;
+		buf[i].len = iov[i].iov_len;
+	}
+	DWORD sz = 0;
+	if (WSASend(sock, buf, n, &sz, 0, NULL, NULL) != 0) {
+		return -1;
+	}
+	return (int)sz;
+}
+
 #endif
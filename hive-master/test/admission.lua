@@ -0,0 +1,46 @@
+local cell = require "cell"
+
+-- ƺ͸ͳ: سˮλʱܾ(shed)
+-- hive.start { thread = 4, main = "test.admission" }
+
+local PORT = 8900
+
+local function dump(t)
+	local r = {}
+	for k, v in pairs(t) do
+		r[#r+1] = k .. "=" .. tostring(v)
+	end
+	table.sort(r)
+	return table.concat(r, " ")
+end
+
+function cell.main()
+	cell.listen("127.0.0.1:" .. PORT, function(fd, addr)
+		cell.fork(function()
+			local sock = cell.bind(fd)
+			sock:write "welcome\n"
+			sock:disconnect()
+		end)
+	end)
+	print(dump(cell.load()))
+	local sock = cell.connect("127.0.0.1", PORT)
+	assert(sock:readline "\n" == "welcome")
+	sock:disconnect()
+
+	-- ڴ泬 1 ֽھ, ӽպر
+	cell.admission { mode = "shed", memory = 1 }
+	cell.sleep(10)
+	sock = cell.connect("127.0.0.1", PORT)
+	print("shed connection reads", sock:readline "\n")
+	sock:disconnect()
+	local load = cell.load()
+	print(dump(load))
+	assert(load.shed > 0)
+
+	cell.admission(nil)
+	sock = cell.connect("127.0.0.1", PORT)
+	assert(sock:readline "\n" == "welcome")
+	sock:disconnect()
+	print("admission ok")
+	cell.exit()
+end
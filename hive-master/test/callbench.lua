@@ -0,0 +1,51 @@
+local cell = require "cell"
+
+-- cell.call Ĳ
+-- hive.start { thread = 4, main = "test.callbench" }
+
+cell.command {
+	echo = function(...)
+		return ...
+	end
+}
+
+local DURATION = 5	-- ÿһֲԵ
+
+--n Эͬʱ echo, ÿ
+local function bench(echo, n)
+	local count = 0
+	local running = n
+	local done = cell.event()
+	local start = os.time()
+	local stop = start + DURATION
+	for i = 1, n do
+		cell.fork(function()
+			while true do
+				for j = 1, 100 do
+					cell.call(echo, "echo", j)
+				end
+				count = count + 100
+				if os.time() >= stop then
+					break
+				end
+			end
+			running = running - 1
+			if running == 0 then
+				cell.wakeup(done)
+			end
+		end)
+	end
+	cell.wait(done)
+	return count / math.max(os.time() - start, 1)
+end
+
+function cell.main(mode)
+	if mode == "echo" then
+		return
+	end
+	local echo = cell.launch("test.callbench", "echo")
+	for _, n in ipairs { 1, 16, 256 } do
+		print(string.format("concurrency %d : %d calls/s", n, bench(echo, n)))
+	end
+	cell.cmd("kill", echo)
+end
@@ -0,0 +1,37 @@
+local cell = require "cell"
+
+-- launch ʱõֽģ·ᱻ, ޸Ĵ clearcache ´ launch ¼
+-- hive.start { thread = 4, main = "test.clearcache" }
+
+local MODULE = "test.cachetmp"
+local FILE = "test/cachetmp.lua"
+
+local function write_module(version)
+	local f = assert(io.open(FILE, "wb"))
+	f:write(string.format([[
+local cell = require "cell"
+function cell.main()
+	return %d
+end
+]], version))
+	f:close()
+end
+
+local function launch()
+	local c, version = cell.launch(MODULE)
+	cell.cmd("kill", c)
+	return version
+end
+
+function cell.main()
+	write_module(1)
+	assert(launch() == 1)
+	write_module(2)
+	-- ʹûİ汾
+	assert(launch() == 1)
+	cell.cmd "clearcache"
+	assert(launch() == 2)
+	os.remove(FILE)
+	print("clearcache ok")
+	cell.exit()
+end
@@ -0,0 +1,39 @@
+local cell = require "cell"
+
+-- cell.command ĵڶĺ, ǲЭֱִ
+-- ֱִеĺ׳
+-- hive.start { thread = 4, main = "test.direct" }
+
+local counter = 0
+
+cell.command({
+	add = function(n)
+		counter = counter + n
+		return counter
+	end,
+	bad = function()
+		cell.sleep(1)
+		return "never"
+	end,
+	slow = function()
+		cell.sleep(1)
+		return "slow"
+	end,
+}, { add = true, bad = true })
+
+function cell.main(mode)
+	if mode == "worker" then
+		return
+	end
+	local worker = cell.launch("test.direct", "worker")
+	assert(cell.call(worker, "add", 1) == 1)
+	assert(cell.call(worker, "add", 2) == 3)
+	local ok, err = pcall(cell.call, worker, "bad")
+	print("bad", ok, err)
+	assert(not ok and err:find "attempt to block in a direct handler")
+	-- ûĺЭִ, 
+	assert(cell.call(worker, "slow") == "slow")
+	print("direct ok")
+	cell.cmd("kill", worker)
+	cell.exit()
+end
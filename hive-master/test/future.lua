@@ -0,0 +1,74 @@
+local cell = require "cell"
+
+-- cell.async  future, cell.await / awaitall / awaitany ȴ, cell.callmulti ͬʱö cell
+-- hive.start { thread = 4, main = "test.future" }
+
+cell.command {
+	echo = function(...)
+		return ...
+	end,
+	sleep = function(ti, ...)
+		cell.sleep(ti)
+		return ...
+	end,
+	fail = function(err)
+		error(err)
+	end,
+}
+
+function cell.main(mode)
+	if mode == "worker" then
+		return
+	end
+	local workers = {}
+	for i = 1, 4 do
+		workers[i] = cell.launch("test.future", "worker")
+	end
+
+	local f = cell.async(workers[1], "echo", "a", "b")
+	local a, b = cell.await(f)
+	assert(a == "a" and b == "b")
+	-- ɵ future ٴ await
+	assert(cell.await(f) == "a")
+
+	local futures = {}
+	for i = 1, 4 do
+		futures[i] = cell.async(workers[i], "sleep", 5 - i, i)
+	end
+	-- 󷢳
+	local i, v = cell.awaitany(futures)
+	assert(i == 4 and v == 4)
+	local r = cell.awaitall(futures)
+	for i = 1, 4 do
+		assert(r[i][1] == i)
+	end
+
+	-- Э̵ȴͬһ future
+	local shared = cell.async(workers[1], "sleep", 10, "shared")
+	local done = cell.event()
+	local waiting = 3
+	for i = 1, 3 do
+		cell.fork(function()
+			assert(cell.await(shared) == "shared")
+			waiting = waiting - 1
+			if waiting == 0 then
+				cell.wakeup(done)
+			end
+		end)
+	end
+	cell.wait(done)
+
+	--  future  await ʱ׳, awaitall ȫɺ׳һ
+	local ok, err = pcall(cell.await, cell.async(workers[2], "fail", "boom"))
+	assert(not ok and err:find "boom")
+	ok, err = pcall(cell.awaitall, { cell.async(workers[1], "echo", 1), cell.async(workers[2], "fail", "oops") })
+	assert(not ok and err:find "oops")
+
+	r = cell.callmulti(workers, "echo", "multi")
+	assert(#r == 4 and r[4][1] == "multi")
+	print("future ok")
+	for i = 1, 4 do
+		cell.cmd("kill", workers[i])
+	end
+	cell.exit()
+end
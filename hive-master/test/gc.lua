@@ -0,0 +1,34 @@
+local cell = require "cell"
+
+-- cell.gc  gc , ߳̿ʱԴϢ cell  gc
+-- hive.start { thread = 4, main = "test.gc" }
+
+cell.command {
+	garbage = function(n)
+		for i = 1, n do
+			local t = { i, tostring(i) }
+		end
+		return collectgarbage "count"
+	end,
+	count = function()
+		return collectgarbage "count"
+	end,
+}
+
+function cell.main(mode)
+	if mode == "worker" then
+		-- Ϣʱٴ gc, Ҫڿʱ
+		cell.gc { pause = 1000, step = 64 }
+		return
+	end
+	local worker = cell.launch("test.gc", "worker")
+	local before = cell.call(worker, "garbage", 100000)
+	-- һ, ù̻߳
+	cell.sleep(100)
+	local after = cell.call(worker, "count")
+	print(string.format("worker memory %.1fK -> %.1fK", before, after))
+	assert(after < before)
+	print("gc ok")
+	cell.cmd("kill", worker)
+	cell.exit()
+end
@@ -0,0 +1,42 @@
+local cell = require "cell"
+
+-- cell.launch ڵߵĹ߳д cell, Э̿ͬʱ launch
+-- hive.start { thread = 4, main = "test.launch" }
+
+local N = 100
+
+function cell.main(mode, ...)
+	if mode == "child" then
+		return ...
+	end
+	local children = {}
+	local done = cell.event()
+	local running = 10
+	for i = 1, 10 do
+		cell.fork(function()
+			for j = 1, N / 10 do
+				local c, a, b = cell.launch("test.launch", "child", i, j)
+				assert(a == i and b == j)
+				children[#children+1] = c
+			end
+			running = running - 1
+			if running == 0 then
+				cell.wakeup(done)
+			end
+		end)
+	end
+	cell.wait(done)
+	assert(#children == N)
+	--  system cell 
+	local c, v = cell.cmd("launch", "test.launch", "child", "system")
+	assert(v == "system")
+	children[#children+1] = c
+	local ok, err = pcall(cell.launch, "test.nosuchcell")
+	print("launch unknown", ok, err)
+	assert(not ok)
+	for _, c in ipairs(children) do
+		cell.cmd("kill", c)
+	end
+	print("launch ok")
+	cell.exit()
+end
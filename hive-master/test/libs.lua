@@ -0,0 +1,35 @@
+local cell = require "cell"
+
+-- cell.launch({ name, libs = {...} }) ֻԤȼزֱ׼, ڵһηʱ
+-- hive.start { thread = 4, main = "test.libs" }
+
+cell.command {
+	check = function()
+		local loaded = {}
+		for _, name in ipairs { "string", "table", "math", "os", "io", "coroutine", "debug" } do
+			loaded[#loaded+1] = name .. "=" .. tostring(package.loaded[name] ~= nil)
+		end
+		return table.concat(loaded, " ")
+	end,
+	use = function()
+		-- ַȫֵĿֱʹ
+		return ("x"):rep(3), math.floor(2.5), os.time() > 0
+	end,
+}
+
+function cell.main(mode)
+	if mode == "worker" then
+		return
+	end
+	local worker = cell.launch({ "test.libs", libs = {} }, "worker")
+	print("before", cell.call(worker, "check"))
+	local s, n, t = cell.call(worker, "use")
+	assert(s == "xxx" and n == 2 and t)
+	print("after", cell.call(worker, "check"))
+	local partial = cell.launch({ "test.libs", libs = { "string" } }, "worker")
+	assert(cell.call(partial, "use") == "xxx")
+	print("libs ok")
+	cell.cmd("kill", worker)
+	cell.cmd("kill", partial)
+	cell.exit()
+end
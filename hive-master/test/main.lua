@@ -3,7 +3,7 @@ local cell = require "cell"
 local function accepter(fd, addr, listen_fd)
 	print("Accept from ", listen_fd)
 	-- can't read fd in this function, because socket.cell haven't forward data from fd
-	local client = cell.cmd("launch", "test.client",fd, addr)
+	local client = cell.launch({ "test.client", libs = {} }, fd, addr)
 	-- return cell the data from fd will forward to, you can also return nil for forwarding to self
 	return client
 end
@@ -19,7 +19,7 @@ function cell.main()
 	sock:write(line .. "\n")
 ]]
 	print(cell.cmd("echo","Hello world"))
-	local ping, pong = cell.cmd("launch", "test.pingpong","pong")
+	local ping, pong = cell.launch("test.pingpong","pong")
 	print(ping,pong)
 	print(cell.call(ping, "ping"))
 	cell.fork(function()
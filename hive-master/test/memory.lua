@@ -0,0 +1,50 @@
+local cell = require "cell"
+
+-- ڴͳƺÿ cell ڴ, ʱ cell еڴʧ
+-- hive.start { thread = 4, main = "test.memory" }
+
+local hold = {}
+
+cell.command {
+	alloc = function(n)
+		for i = 1, n do
+			hold[#hold+1] = string.rep("m", 1024) .. i
+		end
+		return #hold
+	end,
+	free = function()
+		hold = {}
+		collectgarbage()
+	end,
+}
+
+function cell.main(mode)
+	if mode == "worker" then
+		return
+	end
+	local worker = cell.launch("test.memory", "worker")
+	local m = cell.cmd "memory"
+	print("total", m.total, "pool", m.pool)
+	local base = assert(m.cells[worker])
+
+	cell.call(worker, "alloc", 1024)
+	m = cell.cmd "memory"
+	print("worker", base, "->", m.cells[worker])
+	assert(m.cells[worker] > base + 1024 * 1024)
+
+	cell.call(worker, "free")
+	assert(cell.cmd("memlimit", worker, 4 * 1024 * 1024))
+	local ok, err = pcall(cell.call, worker, "alloc", 8 * 1024)
+	print("over limit", ok, err)
+	assert(not ok and err:find "memory")
+	cell.call(worker, "free")
+	-- ȡ޺Լ
+	assert(cell.cmd("memlimit", worker, 0))
+	assert(cell.call(worker, "alloc", 8 * 1024) == 8 * 1024)
+	print("memory ok")
+	cell.cmd("kill", worker)
+	-- رյ cell ٳͳ
+	cell.sleep(10)
+	assert(cell.cmd("memory").cells[worker] == nil)
+	cell.exit()
+end
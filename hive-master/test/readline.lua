@@ -0,0 +1,32 @@
+local cell = require "cell"
+
+-- socket:readline ķָг
+-- hive.start { thread = 4, main = "test.readline" }
+
+local PORT = 8891
+
+function cell.main()
+	local done = cell.event()
+	cell.listen("127.0.0.1:" .. PORT, function(fd, addr)
+		cell.fork(function()
+			local sock = cell.bind(fd)
+			assert(sock:readline "\n" == "hello")
+			assert(sock:readline "\r\n" == "world")
+			-- ָյ
+			assert(sock:readline "||" == "split")
+			local line, err = sock:readline("\n", 16)
+			assert(line == nil and err == "Line too long", err)
+			print("readline ok")
+			sock:disconnect()
+			cell.wakeup(done)
+		end)
+	end)
+	local sock = cell.connect("127.0.0.1", PORT)
+	sock:write "hello\nworld\r\nsplit|"
+	cell.sleep(10)
+	sock:write "|"
+	sock:write(string.rep("x", 1024))
+	cell.wait(done)
+	sock:disconnect()
+	cell.exit()
+end
@@ -0,0 +1,47 @@
+local cell = require "cell"
+
+-- socket:readpacket ȡ 2  4 ֽڳΪͷݰ
+-- hive.start { thread = 4, main = "test.readpacket" }
+
+local PORT = 8892
+
+local function pack2(s)
+	local n = #s
+	return string.char(math.floor(n / 256), n % 256) .. s
+end
+
+local function pack4le(s)
+	local n = #s
+	return string.char(n % 256, math.floor(n / 256) % 256, math.floor(n / 65536) % 256, math.floor(n / 16777216)) .. s
+end
+
+function cell.main()
+	local done = cell.event()
+	cell.listen("127.0.0.1:" .. PORT, function(fd, addr)
+		cell.fork(function()
+			local sock = cell.bind(fd)
+			assert(sock:readpacket() == "first")
+			-- һȡ 3 Ѿȫİ
+			local a, b, c = sock:readpacket(2, "big", 3)
+			assert(a == "a" and b == "bb" and c == "ccc")
+			assert(sock:readpacket(4, "little") == string.rep("z", 70000))
+			local p, err = sock:readpacket(2, "big", 1, 100)
+			assert(p == nil and err == "Packet too large", err)
+			print("readpacket ok")
+			sock:disconnect()
+			cell.wakeup(done)
+		end)
+	end)
+	local sock = cell.connect("127.0.0.1", PORT)
+	-- ͷͰֿ
+	local first = pack2 "first"
+	sock:write(first:sub(1, 1))
+	cell.sleep(10)
+	sock:write(first:sub(2))
+	sock:write(pack2 "a" .. pack2 "bb" .. pack2 "ccc")
+	sock:write(pack4le(string.rep("z", 70000)))
+	sock:write(pack2(string.rep("y", 1000)))
+	cell.wait(done)
+	sock:disconnect()
+	cell.exit()
+end
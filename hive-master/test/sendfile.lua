@@ -0,0 +1,36 @@
+local cell = require "cell"
+
+-- socket:sendfile ļһ, ͨ write ˳򵽴
+-- hive.start { thread = 4, main = "test.sendfile" }
+
+local PORT = 8898
+local FILE = "test/sendfile.lua"
+
+function cell.main()
+	local f = assert(io.open(FILE, "rb"))
+	local content = f:read "*a"
+	f:close()
+	local done = cell.event()
+	cell.listen("127.0.0.1:" .. PORT, function(fd, addr)
+		cell.fork(function()
+			local sock = cell.bind(fd)
+			assert(sock:readline "\n" == "begin")
+			assert(sock:readbytes(#content) == content)
+			assert(sock:readbytes(10) == content:sub(11, 20))
+			assert(sock:readline "\n" == "end")
+			print("sendfile ok")
+			sock:disconnect()
+			cell.wakeup(done)
+		end)
+	end)
+	local sock = cell.connect("127.0.0.1", PORT)
+	sock:write "begin\n"
+	assert(sock:sendfile(FILE))
+	assert(sock:sendfile(FILE, 10, 10))
+	sock:write "end\n"
+	local ok, err = sock:sendfile "test/nosuchfile"
+	assert(ok == nil and err)
+	cell.wait(done)
+	sock:disconnect()
+	cell.exit()
+end
@@ -0,0 +1,30 @@
+local cell = require "cell"
+
+-- socket:timeout ĶʱͿгʱ, ʱӱر, ȴеĶȡ nil
+-- hive.start { thread = 4, main = "test.sockettimeout" }
+
+local PORT = 8899
+
+function cell.main()
+	local done = cell.event()
+	local result = {}
+	cell.listen("127.0.0.1:" .. PORT, function(fd, addr)
+		cell.fork(function()
+			local sock = cell.bind(fd)
+			-- 0.5 ûյݾ͹ر
+			sock:timeout(nil, 50)
+			result[#result+1] = sock:readline "\n"
+			result[#result+1] = sock:readline "\n" or "timeout"
+			cell.wakeup(done)
+		end)
+	end)
+	local sock = cell.connect("127.0.0.1", PORT)
+	cell.sleep(10)
+	sock:write "alive\n"
+	cell.wait(done)
+	assert(result[1] == "alive" and result[2] == "timeout")
+	-- Զ˱رպ߶ӶϿ
+	assert(sock:readline "\n" == nil)
+	print("socket timeout ok")
+	cell.exit()
+end
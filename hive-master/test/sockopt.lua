@@ -0,0 +1,29 @@
+local cell = require "cell"
+
+-- connect/listen ׽ѡ, socket:setopt  backlog
+-- hive.start { thread = 4, main = "test.sockopt" }
+
+local PORT = 8897
+
+function cell.main()
+	local done = cell.event()
+	local listen = cell.listen("127.0.0.1:" .. PORT, function(fd, addr)
+		cell.fork(function()
+			local sock = cell.bind(fd)
+			assert(sock:readline "\n" == "opt")
+			sock:disconnect()
+			cell.wakeup(done)
+		end)
+	end, { backlog = 16, nodelay = true, rcvbuf = 65536 })
+	local sock = cell.connect("127.0.0.1", PORT, { nodelay = true, keepalive = true, sndbuf = 65536 })
+	assert(sock:setopt("nodelay", false))
+	assert(sock:setopt("cork", true))
+	sock:write "opt\n"
+	assert(sock:setopt("cork", false))
+	cell.wait(done)
+	assert(not pcall(sock.setopt, sock, "nosuchoption", 1))
+	print("sockopt ok")
+	sock:disconnect()
+	listen:disconnect()
+	cell.exit()
+end
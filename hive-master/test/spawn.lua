@@ -0,0 +1,27 @@
+local cell = require "cell"
+
+--  cell ٶ, ȽʹúͲʹԤȴ lua_State 
+-- hive.start { thread = 4, main = "test.spawn", pool = 64 }
+-- hive.start { thread = 4, main = "test.spawn" }
+
+local N = 1000
+
+function cell.main(mode)
+	if mode == "child" then
+		return
+	end
+	local children = {}
+	local start = os.clock()
+	for i = 1, N do
+		children[i] = cell.launch("test.spawn", "child")
+		-- ߳ʱ
+		if i % 64 == 0 then
+			cell.sleep(1)
+		end
+	end
+	print(string.format("launch %d cells : %.3f s cpu", N, os.clock() - start))
+	for i = 1, N do
+		cell.cmd("kill", children[i])
+	end
+	cell.exit()
+end
@@ -0,0 +1,47 @@
+local cell = require "cell"
+
+-- óʱȡ: cell.timedcall, cell.await ĳʱ, cell.calltimeout, cell.cancel
+-- ȡٵĻظ
+-- hive.start { thread = 4, main = "test.timeout" }
+
+cell.command {
+	sleep = function(ti, ...)
+		cell.sleep(ti)
+		return ...
+	end,
+}
+
+function cell.main(mode)
+	if mode == "worker" then
+		return
+	end
+	local worker = cell.launch("test.timeout", "worker")
+
+	assert(cell.timedcall(100, worker, "sleep", 1, "fast") == "fast")
+	local ok, err = pcall(cell.timedcall, 10, worker, "sleep", 50, "slow")
+	print("timedcall", ok, err)
+	assert(not ok and err:find "timeout")
+
+	local f = cell.async(worker, "sleep", 50, "late")
+	ok, err = pcall(cell.await, f, 10)
+	assert(not ok and err:find "timeout")
+
+	-- ǰЭе cell.call ʱ
+	cell.calltimeout(10)
+	ok, err = pcall(cell.call, worker, "sleep", 50)
+	assert(not ok and err:find "timeout")
+	assert(cell.call(worker, "sleep", 1, "in time") == "in time")
+	cell.calltimeout(nil)
+
+	f = cell.async(worker, "sleep", 10, "cancelled")
+	cell.cancel(f, "stop")
+	ok, err = pcall(cell.await, f)
+	assert(not ok and err:find "stop")
+
+	-- ȳʱȡĵõĻظ, ӦñĶ
+	cell.sleep(100)
+	assert(cell.call(worker, "sleep", 0, "still works") == "still works")
+	print("timeout ok")
+	cell.cmd("kill", worker)
+	cell.exit()
+end
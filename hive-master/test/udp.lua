@@ -0,0 +1,55 @@
+local cell = require "cell"
+
+-- udp ׽: recv ȡ, صʽ, նʱ
+-- hive.start { thread = 4, main = "test.udp" }
+
+local PORT = 8893
+
+function cell.main()
+	local server = cell.udp("127.0.0.1:" .. PORT)
+	local client = cell.udp("127.0.0.1:" .. (PORT + 1))
+	local to = cell.udpaddress("127.0.0.1", PORT)
+	-- һηͶݱ
+	assert(client:sendto(to, "ping1", to, "ping2"))
+	local data, from = server:recv()
+	assert(data == "ping1")
+	print("from", cell.udpname(from))
+	assert(server:recv() == "ping2")
+	server:sendto(from, "pong")
+	assert(client:recv() == "pong")
+
+	-- صЭִ, 
+	local done = cell.event()
+	local count = 0
+	local echo = cell.udp("127.0.0.1:" .. (PORT + 2), function(data, from)
+		cell.sleep(1)
+		count = count + 1
+		if count == 10 then
+			cell.wakeup(done)
+		end
+	end)
+	local echo_addr = cell.udpaddress("127.0.0.1", PORT + 2)
+	for i = 1, 10 do
+		client:sendto(echo_addr, tostring(i))
+	end
+	cell.wait(done)
+
+	--  4 ݱ, ȡʱı
+	local small = cell.udp("127.0.0.1:" .. (PORT + 3), nil, 4)
+	local small_addr = cell.udpaddress("127.0.0.1", PORT + 3)
+	for i = 1, 10 do
+		client:sendto(small_addr, tostring(i))
+	end
+	cell.sleep(10)
+	print("dropped", small:dropped())
+	assert(small:dropped() == 6)
+	for i = 1, 4 do
+		assert(small:recv() == tostring(i))
+	end
+	print("udp ok")
+	server:disconnect()
+	client:disconnect()
+	echo:disconnect()
+	small:disconnect()
+	cell.exit()
+end
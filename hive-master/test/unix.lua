@@ -0,0 +1,40 @@
+local cell = require "cell"
+
+-- unix ׽ֺ ipv6 ļ
+-- hive.start { thread = 4, main = "test.unix" }
+
+local function echo_server(addr)
+	return cell.listen(addr, function(fd, from, listen, port)
+		print("accept", addr, from, port)
+		cell.fork(function()
+			local sock = cell.bind(fd)
+			local line = sock:readline "\n"
+			sock:write(line .. "\n")
+			sock:disconnect()
+		end)
+	end)
+end
+
+local function echo(addr, port)
+	local sock = cell.connect(addr, port)
+	sock:write "hello\n"
+	local line = sock:readline "\n"
+	sock:disconnect()
+	return line
+end
+
+function cell.main()
+	-- ռ, Ҫɾļ
+	echo_server "unix:@hive.test"
+	assert(echo "unix:@hive.test" == "hello")
+	print("unix ok")
+
+	-- û ipv6 Ļ listen ʧ
+	if pcall(echo_server, "[::1]:8895") then
+		assert(echo("[::1]", 8895) == "hello")
+		print("ipv6 ok")
+	else
+		print("ipv6 not available")
+	end
+	cell.exit()
+end
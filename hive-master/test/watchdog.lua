@@ -0,0 +1,33 @@
+local cell = require "cell"
+
+-- Ź: ϢԤʱӡջ, abort Ϊ true ʱֹδ
+-- hive.start { thread = 4, main = "test.watchdog", watchdog = { time = 100, abort = true } }
+
+cell.command {
+	spin = function(n)
+		local x = 0
+		for i = 1, n do
+			x = x + i
+		end
+		return x
+	end,
+	forever = function()
+		while true do end
+	end,
+}
+
+function cell.main(mode)
+	if mode == "worker" then
+		return
+	end
+	local worker = cell.launch("test.watchdog", "worker")
+	assert(cell.call(worker, "spin", 1000) == 500500)
+	-- ѭֹ, յ, worker ܼϢ
+	local ok, err = pcall(cell.call, worker, "forever")
+	print("forever", ok, err)
+	assert(not ok and err:find "watchdog")
+	assert(cell.call(worker, "spin", 10) == 55)
+	print("watchdog ok")
+	cell.cmd("kill", worker)
+	cell.exit()
+end
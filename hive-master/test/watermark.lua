@@ -0,0 +1,49 @@
+local cell = require "cell"
+
+-- дĸߵˮλ: Զ˲ʱ write , ݽˮλָ
+-- hive.start { thread = 4, main = "test.watermark" }
+
+local PORT = 8896
+local CHUNK = string.rep("x", 64 * 1024)
+local COUNT = 256
+
+function cell.main()
+	local start = cell.event()
+	local done = cell.event()
+	local received = 0
+	cell.listen("127.0.0.1:" .. PORT, function(fd, addr)
+		cell.fork(function()
+			local sock = cell.bind(fd)
+			-- Ȳ, ÷ͷдǵˮλ
+			cell.wait(start)
+			while received < #CHUNK * COUNT do
+				local data = sock:readbytes(#CHUNK)
+				assert(data)
+				received = received + #data
+			end
+			sock:disconnect()
+			cell.wakeup(done)
+		end)
+	end)
+	local sock = cell.connect("127.0.0.1", PORT)
+	sock:watermark(1024 * 1024, 256 * 1024)
+	local written = 0
+	local blocked = false
+	cell.fork(function()
+		for i = 1, COUNT do
+			sock:write(CHUNK)
+			written = written + 1
+		end
+	end)
+	cell.sleep(50)
+	-- ں˻ 1M ĸˮλ 16M 
+	blocked = written < COUNT
+	print("written before read", written, "blocked", blocked)
+	assert(blocked)
+	cell.wakeup(start)
+	cell.wait(done)
+	assert(written == COUNT)
+	print("watermark ok", received)
+	sock:disconnect()
+	cell.exit()
+end
@@ -0,0 +1,38 @@
+local cell = require "cell"
+
+-- Эֱڱ cell дͬһ, Զ˰ж; Ͽ write  false
+-- hive.start { thread = 4, main = "test.write" }
+
+local PORT = 8890
+local N = 1000
+local WRITER = 4
+
+function cell.main()
+	local done = cell.event()
+	local count = 0
+	cell.listen("127.0.0.1:" .. PORT, function(fd, addr)
+		cell.fork(function()
+			local sock = cell.bind(fd)
+			while count < N * WRITER do
+				local line = sock:readline "\n"
+				assert(line and line:find "^%d+:%d+$", line)
+				count = count + 1
+			end
+			sock:disconnect()
+			cell.wakeup(done)
+		end)
+	end)
+	local sock = cell.connect("127.0.0.1", PORT)
+	for w = 1, WRITER do
+		cell.fork(function()
+			for i = 1, N do
+				assert(sock:write(w .. ":" .. i .. "\n"))
+			end
+		end)
+	end
+	cell.wait(done)
+	sock:disconnect()
+	assert(sock:write "closed\n" == false)
+	print("write ok", count)
+	cell.exit()
+end